@@ -0,0 +1,131 @@
+/*      _____                __    ______
+ *     / ___ \              / /   /___  /
+ *    / /__/ /___  ____  __/ /_______/ /    ____  ____
+ *   / _____/ __ \/ __ \/_   _/ __  / /    / __ \/ __ \
+ *  / /    /  ___/ / / / / /_/ /_/ / /____/  ___/ / / /
+ * /_/     \____/_/ /_/ /___/\__,_/______/\____/_/ /_/
+ *
+ * PentaZen, a Gomoku/Renju playing engine developed by Sun Yuliang.
+ */
+
+#include "protocol.h"
+
+#include "thread.h"
+#include "tt.h"
+
+#include <sstream>
+
+namespace {
+
+struct BenchPosition {
+    Rule        rule;
+    const char *moves;
+};
+
+// Positions of 15x15 games, moves given as "rank,file" in the order played
+constexpr BenchPosition Positions[] = {
+    {FREESTYLE, "7,7 6,5 8,5 6,4 7,4 6,3 6,2 5,3 7,3 7,5 4,2 6,6 6,7 8,4"},
+    {FREESTYLE, "7,7 6,9 9,6 6,10 7,4 8,5 9,4 8,4 6,6 6,11 6,12 8,6"},
+    {FREESTYLE, "7,7 6,6 5,6 5,9 6,5 4,8 9,9 4,7 5,7 5,5 4,6 3,5 6,10"},
+    {FREESTYLE, "7,7 7,6 6,9 9,8 6,6 8,7 6,5 6,7 5,7 11,10 10,9 7,5 7,9 8,9 7,8 5,8 4,9"},
+    {FREESTYLE, "7,7 6,9 8,9 5,9 4,9 6,8 6,7 5,8 5,10 7,8 8,8 3,8 4,8 4,7"},
+    {STANDARD, "7,7 6,9 5,9 6,10 6,11 8,11 5,10 6,6 4,9 3,8 8,13 7,12"},
+    {STANDARD, "7,7 6,9 5,6 5,7 4,7 7,4 4,6 6,6 4,8 4,9 3,8 6,5 6,7 4,5 5,5 6,4 2,8 1,8 3,7 1,9 3,6 6,3 6,2 3,9 2,3 1,6 2,9 1,10"},
+    {STANDARD, "7,7 5,7 5,6 6,8 7,9 4,8 9,7 6,10 5,9 5,5 6,9 8,9 6,6 4,6 4,7"},
+    {STANDARD, "7,7 6,8 8,6 5,8 5,7 6,6 6,9 5,9 3,9 4,8 7,8 6,10 3,7"},
+    {STANDARD, "7,7 9,5 5,6 9,4 5,5 5,7 11,6 8,4 7,5 4,8 7,3 8,5 6,4 4,6 8,6 5,3 5,9"},
+    {RENJU, "7,7 6,6 5,7 6,5 6,4 8,4 5,5 7,3 4,6 6,8 6,2 5,4 4,3"},
+    {RENJU, "7,7 8,5 9,8 6,7 7,10 5,5 8,9 10,7 5,9 12,9 6,9 7,9 9,12 9,6 11,8"},
+    {RENJU, "7,7 6,5 7,9 5,4 5,7 6,6 5,5 5,9 4,6 6,8"},
+    {RENJU, "7,7 7,6 6,9 9,8 4,7 5,9 8,7 5,7 5,5 5,8 5,6"},
+    {RENJU, "7,7 8,8 8,9 5,9 9,8 6,10 5,5 7,10 7,9 6,6 9,9 10,9"},
+};
+
+} // namespace
+
+// bench() searches the built-in positions to a fixed depth and prints total
+// nodes, nps and a signature of node counts and best moves. The signature is
+// stable with one thread, so that a change can be checked for identity of the
+// search behaviour. Only the freestyle positions are searched on the 20x20 board.
+// Usage: bench [depth = 14] [threads = 1] [hash = TT_SIZE] [side = 15]
+void bench(std::istream &is) {
+    std::string token;
+    int         r, f;
+    char        comma;
+
+    const int depth     = (is >> token) ? std::stoi(token) : 14;
+    const int threads   = (is >> token) ? std::stoi(token) : 1;
+    const int hash      = (is >> token) ? std::stoi(token) : TT_SIZE;
+    const int boardSide = (is >> token) ? std::stoi(token) : 15;
+
+    if ((boardSide != 15 && boardSide != 20) || !pattern_available(boardSide)) {
+        sync_cout << "ERROR unsupported size" << sync_endl;
+        return;
+    }
+
+    const size_t    threadNum    = Threads.threadNum;
+    const size_t    hashSize     = TT.mb_size();
+    const int       side         = Threads.side;
+    const Rule      rule         = Threads.rule;
+    const Depth     depthLimit   = Threads.depthLimit;
+    const TimePoint timeoutTurn  = Threads.timeoutTurn;
+    const TimePoint timeoutMatch = Threads.timeoutMatch;
+    const TimePoint timeLeft     = Threads.timeLeft;
+    const bool      ponderMode   = Threads.ponderMode;
+
+    TimeManagement timer;
+    uint64_t       nodes = 0, signature = 0;
+    int            cnt   = 0;
+
+    Threads.set(threads);
+    Threads.set_side(boardSide);
+    TT.resize(hash);
+    Threads.clear_history();
+    Threads.depthLimit   = Depth(depth);
+    Threads.timeoutTurn  = 2147483647;
+    Threads.timeoutMatch = 2147483647;
+    Threads.timeLeft     = 2147483647;
+    Threads.ponderMode   = false; // Pondering after a search would never finish
+    timer.reset();
+
+    for (auto &bp : Positions) {
+        ++cnt;
+
+        // Only freestyle is supported on the larger board
+        if (boardSide == 20 && bp.rule != FREESTYLE)
+            continue;
+
+        sync_cout << "MESSAGE bench position " << cnt << "/" << std::size(Positions) << sync_endl;
+
+        Threads.set_rule(bp.rule);
+        Threads.reset();
+
+        std::istringstream ms(bp.moves);
+        while (ms >> r >> comma >> f)
+            Threads.do_move(make_move(r, f));
+
+        Threads.think_and_move();
+        Threads.main()->wait_for_search_finished();
+
+        // Mix node count and best move into the signature, FNV-1a style
+        nodes += Threads.get_node_cnt();
+        signature = (signature ^ Threads.get_node_cnt()) * 0x100000001B3ULL;
+        signature = (signature ^ Threads.last_move()) * 0x100000001B3ULL;
+    }
+
+    const TimePoint elapsed = timer.elapsed() + 1; // Add one to avoid divided by 0
+
+    sync_cout << "MESSAGE bench nodes " << nodes << " time " << elapsed << " nps " << nodes * 1000 / elapsed << " signature " << signature << sync_endl;
+
+    // Restore the game settings and start a new game
+    Threads.set(threadNum);
+    TT.resize(hashSize);
+    Threads.set_side(side);
+    Threads.set_rule(rule);
+    Threads.reset();
+    Threads.depthLimit   = depthLimit;
+    Threads.timeoutTurn  = timeoutTurn;
+    Threads.timeoutMatch = timeoutMatch;
+    Threads.timeLeft     = timeLeft;
+    Threads.ponderMode   = ponderMode;
+}
@@ -12,22 +12,27 @@
 
 #include "thread.h"
 
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <string>
 
-#ifdef BOARD_SIDE_EQUALS_20
-#    include "pattern_20f.h"
-#endif
-
-#ifdef BOARD_SIDE_EQUALS_15
+#ifndef NO_EMBEDDED_PATTERN
 #    include "pattern_15f.h"
-#endif
+#    include "pattern_15s.h"
 
-#include "pattern_15s.h"
+// The table of the 20x20 board is large, so it is embedded only on request
+#    ifdef EMBED_PATTERN_20
+#        include "pattern_20f.h"
+#    endif
+#endif
 
-NArray<int, MOVE_CAPACITY, DIRECTION_NUM> Board::indexOfTable;
-NArray<int, MOVE_CAPACITY, DIRECTION_NUM> Board::indexOnTable;
-NArray<Score, 16384>                      Board::seeTable;
+template <int S>
+NArray<int, MOVE_CAPACITY, DIRECTION_NUM> Board<S>::indexOfTable;
+template <int S>
+NArray<int, MOVE_CAPACITY, DIRECTION_NUM> Board<S>::indexOnTable;
+template <int S>
+NArray<Score, 16384> Board<S>::seeTable;
 
 namespace {
 
@@ -59,85 +64,197 @@ constexpr Score SeeHelper[MATERIAL_NUM] = {
     B1SeeScore,
 };
 
+template <int S>
 Move start_of(Move m, Direction d) {
-    while (is_ok(m - D[d]))
+    while (is_ok(m - D[d], S))
         m -= D[d];
     return m;
 }
 
+template <int S>
 Move end_of(Move m, Direction d) {
-    while (is_ok(m + D[d]))
+    while (is_ok(m + D[d], S))
         m += D[d];
     return m;
 }
 
+template <int S>
 int mdiag_of(Move m) {
-    Move s = start_of(m, D_MDIAG);
+    Move s = start_of<S>(m, D_MDIAG);
     int  r = rank_of(s);
-    return r == 0 ? file_of(s) : r + BOARD_SIDE - 1;
+    return r == 0 ? file_of(s) : r + S - 1;
 }
 
+template <int S>
 int adiag_of(Move m) {
-    Move s = start_of(m, D_ADIAG);
+    Move s = start_of<S>(m, D_ADIAG);
     int  r = rank_of(s);
-    return r == 0 ? file_of(s) : r + BOARD_SIDE - 1;
+    return r == 0 ? file_of(s) : r + S - 1;
 }
 
+template <int S>
 int mdiag_index_on(Move m) {
     int ret = 0;
-    while (is_ok(m - D[D_MDIAG])) {
+    while (is_ok(m - D[D_MDIAG], S)) {
         m -= D[D_MDIAG];
         ++ret;
     }
     return ret;
 }
 
+template <int S>
 int adiag_index_on(Move m) {
     int ret = 0;
-    while (is_ok(m - D[D_ADIAG])) {
+    while (is_ok(m - D[D_ADIAG], S)) {
         m -= D[D_ADIAG];
         ++ret;
     }
     return ret;
 }
 
+template <int S>
 int index_of_helper(Move m, Direction d) {
-    return d == D_RANK ? rank_of(m) : d == D_FILE ? file_of(m) + BOARD_SIDE :
-                                  d == D_MDIAG    ? mdiag_of(m) + BOARD_SIDE * 2 :
-                                  d == D_ADIAG    ? adiag_of(m) + BOARD_SIDE * 4 - 1 :
+    return d == D_RANK ? rank_of(m) : d == D_FILE ? file_of(m) + S :
+                                  d == D_MDIAG    ? mdiag_of<S>(m) + S * 2 :
+                                  d == D_ADIAG    ? adiag_of<S>(m) + S * 4 - 1 :
                                                     0;
 }
 
+template <int S>
 int index_on_helper(Move m, Direction d) {
     return d == D_RANK ? file_of(m) : d == D_FILE ? rank_of(m) :
-                                  d == D_MDIAG    ? mdiag_index_on(m) :
-                                  d == D_ADIAG    ? adiag_index_on(m) :
+                                  d == D_MDIAG    ? mdiag_index_on<S>(m) :
+                                  d == D_ADIAG    ? adiag_index_on<S>(m) :
                                                     0;
 }
 
-} // namespace
+// Pattern tables of freestyle and standard, generated by the pattern generator.
+// A table has a row for each line index, padded to a power of 2 number of 16-bit
+// entries, and the entries index a value table. Lines of the 20x20 board need a
+// table of longer lines, which only freestyle is played on.
+enum PatternTableType {
+    PATTERN_15F,
+    PATTERN_15S,
+    PATTERN_20F,
+    PATTERN_TABLE_NUM
+};
 
-// F3 pack update function
-template <Rule r>
-void F3Pack::update(const Board &bd) {
-    int ind1 = 0, ind2 = 0;
+constexpr int row_size_of(int lineLen) {
+    return lineLen < 16 ? 16 : 32;
+}
 
-    memset(F4a, 0, sizeof(F4a));
-    memset(F3d, 0, sizeof(F3d));
+constexpr int         PatternLineLen[PATTERN_TABLE_NUM] = {15, 15, 20};
+constexpr int         PatternRowSize[PATTERN_TABLE_NUM] = {row_size_of(15), row_size_of(15), row_size_of(20)};
+constexpr const char *PatternFile[PATTERN_TABLE_NUM]    = {"pattern_15f.bin", "pattern_15s.bin", "pattern_20f.bin"};
 
-    for (auto m = move - D[direction] * 4; m <= move + D[direction] * 4; m += D[direction])
-        if (bd.is_empty(m)) {
-            if (ind1 < F3Pack::F4a_SIZE && bd.query<US, INC>(piece, m, F4) > 0)
-                F4a[ind1++] = m;
+struct PatternTable {
+    const uint16_t *rows;
+    const uint32_t *values;
+};
 
-            if (ind2 < F3Pack::F3d_SIZE && bd.query<OPP, DEC>(~piece, m, F3) > 0)
-                F3d[ind2++] = m;
-        }
+#ifndef NO_EMBEDDED_PATTERN
+static_assert(sizeof(Pattern_f[0]) == PatternRowSize[PATTERN_15F] * sizeof(uint16_t), "unexpected row size of the embedded table");
+static_assert(sizeof(Pattern_s[0]) == PatternRowSize[PATTERN_15S] * sizeof(uint16_t), "unexpected row size of the embedded table");
+#    ifdef EMBED_PATTERN_20
+static_assert(sizeof(Pattern_20_f[0]) == PatternRowSize[PATTERN_20F] * sizeof(uint16_t), "unexpected row size of the embedded table");
+
+PatternTable Patterns[PATTERN_TABLE_NUM] = {{Pattern_f[0], PatternValue_f}, {Pattern_s[0], PatternValue_s}, {Pattern_20_f[0], PatternValue_20_f}};
+#    else
+PatternTable Patterns[PATTERN_TABLE_NUM] = {{Pattern_f[0], PatternValue_f}, {Pattern_s[0], PatternValue_s}, {nullptr, nullptr}};
+#    endif
+#else
+PatternTable Patterns[PATTERN_TABLE_NUM];
+#endif
+
+// A binary pattern file consists of a header, zero padding up to DataOffset, the
+// rows and then the value table, as written by the pattern generator. The layout
+// must be kept the same as PatternFileHeader of the generator.
+constexpr char     PatternFileMagic[8]                = {'P', 'Z', 'P', 'A', 'T', 'T', 'R', 'N'};
+constexpr uint32_t PatternFileVersion                 = 1;
+constexpr size_t   PatternFileDataOffset              = 65536;
+constexpr uint32_t PatternFileRule[PATTERN_TABLE_NUM] = {0, 1, 0}; // Rule enum of the generator
+
+struct PatternFileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t rule;
+    uint32_t lineLen;
+    uint32_t rowSize;
+    uint32_t rowCount;
+    uint32_t valueCount;
+    uint64_t checksum;
+};
+
+// Return the checksum of the data of a pattern file, FNV-1a style on 32-bit words
+uint64_t pattern_checksum(const uint32_t *data, size_t wordCnt) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i != wordCnt; ++i)
+        h = (h ^ data[i]) * 0x100000001B3ULL;
+
+    return h;
+}
+
+// Map the pattern table from the binary file. The mapping is never written to,
+// so all processes mapping the file share the same physical pages of the page
+// cache. Returns false and keeps the table if the file is missing or invalid.
+bool map_pattern_file(PatternTableType t, const std::string &path) {
+    std::ifstream     ifs(path, std::ios::binary | std::ios::ate);
+    PatternFileHeader header;
+
+    if (!ifs)
+        return false;
+
+    const size_t fileSize = size_t(ifs.tellg());
+    const size_t rowCount = size_t(1) << (PatternLineLen[t] + 1);
+
+    ifs.seekg(0);
+    if (!ifs.read(reinterpret_cast<char *>(&header), sizeof(header))
+        || std::memcmp(header.magic, PatternFileMagic, sizeof(header.magic))
+        || header.version != PatternFileVersion
+        || header.rule != PatternFileRule[t]
+        || header.lineLen != uint32_t(PatternLineLen[t])
+        || header.rowSize != uint32_t(PatternRowSize[t])
+        || header.rowCount != rowCount
+        || header.valueCount == 0
+        || fileSize != PatternFileDataOffset + rowCount * PatternRowSize[t] * sizeof(uint16_t) + header.valueCount * sizeof(uint32_t))
+        return false;
+
+    const size_t dataSize = fileSize - PatternFileDataOffset;
+    void *       data     = map_file(path, PatternFileDataOffset, dataSize);
+
+    if (!data)
+        return false;
+
+    if (pattern_checksum(static_cast<const uint32_t *>(data), dataSize / sizeof(uint32_t)) != header.checksum) {
+        unmap_file(data, dataSize);
+        return false;
+    }
+
+    Patterns[t].rows   = static_cast<const uint16_t *>(data);
+    Patterns[t].values = reinterpret_cast<const uint32_t *>(Patterns[t].rows + rowCount * PatternRowSize[t]);
+    return true;
+}
+
+// Return the pattern table row of the line index for the piece, and the value
+// table that the entries of the row index. The side and the rule are template
+// parameters so that the table is chosen at compile time, except for renju where
+// black and white use different tables.
+template <int S, Rule R>
+const uint16_t *pattern_entry(Piece p, int ind, const uint32_t *&value) {
+    const PatternTableType t = S == 20 ? PATTERN_20F : R == FREESTYLE || (R == RENJU && p == WHITE) ? PATTERN_15F :
+                                                                                                      PATTERN_15S;
+
+    value = Patterns[t].values;
+    return Patterns[t].rows + ind * PatternRowSize[t];
 }
 
-// F3 pack update function for black in renju rule
-template <>
-void F3Pack::update<RENJU>(const Board &bd) {
+} // namespace
+
+// F3 pack update function. RENJU is for black in renju rule, where the F4 to
+// attack must not be a foul.
+template <Rule R, int S>
+void F3Pack::update(const Board<S> &bd) {
     int ind1 = 0, ind2 = 0;
 
     memset(F4a, 0, sizeof(F4a));
@@ -145,15 +262,19 @@ void F3Pack::update<RENJU>(const Board &bd) {
 
     for (auto m = move - D[direction] * 4; m <= move + D[direction] * 4; m += D[direction])
         if (bd.is_empty(m)) {
-            if (ind1 < F3Pack::F4a_SIZE && bd.query<US, INC>(piece, m, C6) == 0 && bd.query<US, INC>(piece, m, F4) == 1 && bd.query<US, INC>(piece, m, B4) == 0 && bd.query<US, INC>(piece, m, F3) <= 1)
+            if constexpr (R == RENJU) {
+                if (ind1 < F3Pack::F4a_SIZE && bd.template query<US, INC>(piece, m, C6) == 0 && bd.template query<US, INC>(piece, m, F4) == 1 && bd.template query<US, INC>(piece, m, B4) == 0 && bd.template query<US, INC>(piece, m, F3) <= 1)
+                    F4a[ind1++] = m;
+            } else if (ind1 < F3Pack::F4a_SIZE && bd.template query<US, INC>(piece, m, F4) > 0)
                 F4a[ind1++] = m;
 
-            if (ind2 < F3Pack::F3d_SIZE && bd.query<OPP, DEC>(~piece, m, F3) > 0)
+            if (ind2 < F3Pack::F3d_SIZE && bd.template query<OPP, DEC>(~piece, m, F3) > 0)
                 F3d[ind2++] = m;
         }
 }
 
-Board::Board() {
+template <int S>
+Board<S>::Board() {
     mutex.lock();
     if (tableGenerated == false) {
         table_init();
@@ -163,136 +284,196 @@ Board::Board() {
     reset();
 }
 
-Board::Board(const Board &bd) {
-    reset();
-    for (auto i = 0; i != bd.pieceCnt; ++i)
-        do_move(bd.pieceList[i]);
+template <int S>
+Board<S>::Board(const Board &bd) {
+    copy_from(bd);
 }
 
-Board &Board::operator=(const Board &bd) {
-    reset();
-    for (auto i = 0; i != bd.pieceCnt; ++i)
-        do_move(bd.pieceList[i]);
+template <int S>
+Board<S> &Board<S>::operator=(const Board &bd) {
+    if (this != &bd)
+        copy_from(bd);
     return *this;
 }
 
-ZobristKey Board::key_after(Move m) const {
+// Copy the whole state of another board. Stack arrays are only copied up to
+// the current piece count because the entries above are dead and will be
+// rewritten before being read.
+template <int S>
+void Board<S>::copy_from(const Board &bd) {
+    pieceCnt   = bd.pieceCnt;
+    sideToMove = bd.sideToMove;
+    oppoToMove = bd.oppoToMove;
+    key        = bd.key;
+
+    // Position arrays
+    std::copy_n(bd.pieceList.begin(), pieceCnt, pieceList.begin());
+    board       = bd.board;
+    materialInc = bd.materialInc;
+    see         = bd.see;
+    vectorBoard = bd.vectorBoard;
+    interval    = bd.interval;
+    F3FormedCnt = bd.F3FormedCnt;
+    foulKey     = bd.foulKey;
+    foulTested  = bd.foulTested;
+    foulSquares = bd.foulSquares;
+
+    // Live range of stack arrays
+    std::copy_n(bd.material.begin(), pieceCnt + 1, material.begin());
+    std::copy_n(bd.score.begin(), pieceCnt + 1, score.begin());
+    std::copy_n(bd.seeStack.begin(), pieceCnt, seeStack.begin());
+    std::copy_n(bd.mListLog.begin(), pieceCnt + 1, mListLog.begin());
+    mList = bd.mList;
+    std::copy_n(bd.F3Stack.begin(), pieceCnt + 1, F3Stack.begin());
+    std::copy_n(bd.F3Pool.begin(), F3Stack[pieceCnt].packCnt, F3Pool.begin());
+    std::copy_n(bd.F3Dropped.begin(), F3Stack[pieceCnt].droppedEnd, F3Dropped.begin());
+    std::copy_n(bd.B4dStack.begin(), pieceCnt + 1, B4dStack.begin());
+    std::copy_n(bd.updatedInterval.begin(), pieceCnt + 1, updatedInterval.begin());
+    std::copy_n(bd.updatedMoveList.begin(), pieceCnt + 1, updatedMoveList.begin());
+}
+
+template <int S>
+ZobristKey Board<S>::key_after(Move m) const {
     return key ^ Zobrists[sideToMove][m];
 }
 
-template <>
-void Board::line_update<INC>(Piece p, Move m, Direction d, const Interval &itv) {
-    int iof = index_of(m, d);
-    int ion = index_on(m, d);
+// Update the line info of the piece on the interval. INC adds the new info and
+// updates see array, DEC substracts the old info.
+template <int S>
+template <Rule R, Operation O>
+void Board<S>::line_update(Piece p, Move m, Direction d, const Interval &itv) {
+    if constexpr (O == INC) {
+        int iof = index_of(m, d);
+        int ion = index_on(m, d);
+
+        // Reset related see array elements if interval length is smaller than 5
+        if (itv.length() < 5) {
+            for (auto i = itv.begin(); i != itv.end(); ++i)
+                see[p][iof][i] = 0;
+            return;
+        }
 
-    // Reset related see array elements if interval length is smaller than 5
-    if (itv.length() < 5) {
-        for (auto i = itv.begin(); i != itv.end(); ++i)
-            see[p][iof][i] = 0;
-        return;
-    }
+        // Get main table row pointer
+        const uint32_t *value;
+        const uint16_t *ptr = pattern_entry<S, R>(p, query_vectorBoard(p, iof, itv) + (1 << itv.length()) - 1, value);
 
-    // Get main table entry pointer
-    const uint32_t *ptr = (Threads.rule == FREESTYLE || (Threads.rule == RENJU && p == WHITE)) ? Pattern_f[query_vectorBoard(p, iof, itv) + (1 << itv.length()) - 1] : Pattern_s[query_vectorBoard(p, iof, itv) + (1 << itv.length()) - 1];
+        F3Pack pack(p, m, d, iof);
+        bool   formF3 = false;
+        int    ind1 = 0, ind2 = 0;
 
-    F3Pack pack(p, m, d, iof);
-    bool   formF3 = false;
-    int    ind1 = 0, ind2 = 0;
+        // The first element contains merged material info
+        uint32_t ele = value[*ptr++], mat;
 
-    // The first element contains merged material info
-    uint32_t ele = *ptr++, mat;
+        // Update materialInc and score
+        while ((mat = (ele & 0xf)) != MATERIAL_NONE) {
+            ele >>= 4;
+            ++materialInc[p][mat];
+            score[pieceCnt][p] += ScoreHelper[mat];
 
-    // Update materialInc and score
-    while ((mat = (ele & 0xf)) != MATERIAL_NONE) {
-        ele >>= 4;
-        ++materialInc[p][mat];
-        score[pieceCnt][p] += ScoreHelper[mat];
+            if (mat == F3)
+                formF3 = true;
+        }
 
-        if (mat == F3)
-            formF3 = true;
-    }
+        // The rest elements contain see info. Copy them to the relevant see array
+        // elements. If new F3 is formed and does not exist in F3 pack pool yet,
+        // construct the pack and save it in the pool.
+        const F3Pack *packsBegin = F3Pool.data();
+        const F3Pack *packsEnd   = F3Pool.data() + F3Stack[pieceCnt].packCnt;
 
-    // The rest elements contain see info. Copy them to the relevant see array
-    // elements. If new F3 is formed and does not exist in F3 stack yet, construct
-    // the pack and save it in F3Stack.
-    if (formF3 && std::find(F3Stack[pieceCnt].begin(), F3Stack[pieceCnt].end(), pack) == F3Stack[pieceCnt].end()) {
-        for (auto i = itv.begin(); i != itv.end(); ++i) {
-            // Construct F3 pack
-            if ((*ptr & (1u << 2)) && ind1 < F3Pack::F4a_SIZE)
-                pack.F4a[ind1++] = m + D[d] * (i - ion);
+        if (formF3 && std::find(packsBegin, packsEnd, pack) == packsEnd) {
+            for (auto i = itv.begin(); i != itv.end(); ++i) {
+                const uint32_t info = value[*ptr++];
 
-            if ((*ptr & (1u << 25)) && ind2 < F3Pack::F3d_SIZE)
-                pack.F3d[ind2++] = m + D[d] * (i - ion);
+                // Construct F3 pack
+                if ((info & (1u << 2)) && ind1 < F3Pack::F4a_SIZE)
+                    pack.F4a[ind1++] = m + D[d] * (i - ion);
 
-            // Save move defending B4
-            if (*ptr & (1u << 24))
-                B4dStack[pieceCnt] = m + D[d] * (i - ion);
+                if ((info & (1u << 25)) && ind2 < F3Pack::F3d_SIZE)
+                    pack.F3d[ind2++] = m + D[d] * (i - ion);
 
-            // Update see array
-            see[p][iof][i] = *ptr++;
-        }
+                // Save move defending B4
+                if (info & (1u << 24))
+                    B4dStack[pieceCnt] = m + D[d] * (i - ion);
 
-        // Save F3 pack
-        F3Stack[pieceCnt].emplace_back(pack);
-    }
+                // Update see array
+                see[p][iof][i] = info;
+            }
 
-    // No F3 forms
-    else
-        for (auto i = itv.begin(); i != itv.end(); ++i) {
-            // Save move defending B4
-            if (*ptr & (1u << 24))
-                B4dStack[pieceCnt] = m + D[d] * (i - ion);
+            // Save F3 pack
+            assert(F3Stack[pieceCnt].packCnt < F3PoolSize);
 
-            // Update see array
-            see[p][iof][i] = *ptr++;
+            F3Pool[F3Stack[pieceCnt].packCnt++] = pack;
         }
-}
 
-template <>
-void Board::line_update<DEC>(Piece p, Move m, Direction d, const Interval &itv) {
-    // Nothing to do if interval length is smaller than 5
-    if (itv.length() < 5)
-        return;
+        // No F3 forms
+        else
+            for (auto i = itv.begin(); i != itv.end(); ++i) {
+                const uint32_t info = value[*ptr++];
 
-    const int tmp = query_vectorBoard(p, index_of(m, d), itv);
+                // Save move defending B4
+                if (info & (1u << 24))
+                    B4dStack[pieceCnt] = m + D[d] * (i - ion);
 
-    // Nothing to do if there is no piece on the interval
-    if (tmp == 0)
-        return;
+                // Update see array
+                see[p][iof][i] = info;
+            }
+    } else {
+        // Nothing to do if interval length is smaller than 5
+        if (itv.length() < 5)
+            return;
+
+        const int tmp = query_vectorBoard(p, index_of(m, d), itv);
 
-    // Get main table entry pointer
-    const uint32_t *ptr = (Threads.rule == FREESTYLE || (Threads.rule == RENJU && p == WHITE)) ? Pattern_f[tmp + (1 << itv.length()) - 1] : Pattern_s[tmp + (1 << itv.length()) - 1];
+        // Nothing to do if there is no piece on the interval
+        if (tmp == 0)
+            return;
 
-    // The first element contains merged material info
-    uint32_t ele = *ptr, mat;
+        // Get main table row pointer
+        const uint32_t *value;
+        const uint16_t *ptr = pattern_entry<S, R>(p, tmp + (1 << itv.length()) - 1, value);
 
-    // Update materialInc and score
-    while ((mat = (ele & 0xf)) != MATERIAL_NONE) {
-        ele >>= 4;
-        --materialInc[p][mat];
-        score[pieceCnt][p] -= ScoreHelper[mat];
+        // The first element contains merged material info
+        uint32_t ele = value[*ptr], mat;
+
+        // Update materialInc and score
+        while ((mat = (ele & 0xf)) != MATERIAL_NONE) {
+            ele >>= 4;
+            --materialInc[p][mat];
+            score[pieceCnt][p] -= ScoreHelper[mat];
+        }
     }
 }
 
-void Board::F3Packs_update() {
-    int16_t F3cnt[PIECE_NUM] = {0, 0};
-    auto    it               = F3Stack[pieceCnt].begin();
+template <int S>
+template <Rule R>
+void Board<S>::F3Packs_update() {
+    F3Record &rec              = F3Stack[pieceCnt];
+    int16_t   F3cnt[PIECE_NUM] = {0, 0};
+    int       last             = 0;
+
+    for (auto i = 0; i != rec.packCnt; ++i) {
+        F3Pack &pack = F3Pool[i];
 
-    while (it != F3Stack[pieceCnt].end()) {
         // Update each F3 pack
-        Threads.rule == RENJU && it->piece == BLACK ? it->update<RENJU>(*this) : it->update<FREESTYLE>(*this);
-
-        // Erase if not valid after update
-        if (!it->valid())
-            it = F3Stack[pieceCnt].erase(it);
-        else {
-            ++F3cnt[it->piece];
-            if (it->gen <= 0)
-                ++F3FormedCnt[it->piece]; // Record exact F3 formed number for foul judgement
-            it++->gen += 1;
+        R == RENJU && pack.piece == BLACK ? pack.update<RENJU, S>(*this) : pack.update<FREESTYLE, S>(*this);
+
+        // Drop if not valid after update, otherwise keep it packed in the pool.
+        // Packs of the ply before are logged when dropped.
+        if (pack.valid()) {
+            ++F3cnt[pack.piece];
+            if (pack.gen <= 0)
+                ++F3FormedCnt[pack.piece]; // Record exact F3 formed number for foul judgement
+            pack.gen += 1;
+            F3Pool[last++] = pack;
+        } else if (i < F3Stack[pieceCnt - 1].packCnt) {
+            assert(rec.droppedEnd < F3DropSize);
+
+            F3Dropped[rec.droppedEnd++] = {pack, i};
         }
     }
 
+    rec.packCnt = last;
+
     // Re-update F3 in material
     for (auto p = Piece(0); p != PIECE_NUM; ++p)
         material[pieceCnt][p][F3] = F3cnt[p];
@@ -302,15 +483,46 @@ void Board::F3Packs_update() {
         materialInc[p][F3] = material[pieceCnt][p][F3] - material[pieceCnt - 1][p][F3];
 }
 
-void Board::update_material_see(Move m) {
+// Restore the F3 packs of the ply before the last move. The packs formed by the
+// move are cut off, the dropped ones are put back to their indices in ascending
+// order, and then all packs are updated on the restored board.
+template <int S>
+void Board<S>::F3Packs_restore() {
+    const F3Record &rec  = F3Stack[pieceCnt + 1];
+    const F3Record &prev = F3Stack[pieceCnt];
+    int             cnt  = prev.packCnt - (rec.droppedEnd - prev.droppedEnd);
+
+    for (auto i = prev.droppedEnd; i != rec.droppedEnd; ++i) {
+        const F3Drop &drop = F3Dropped[i];
+
+        std::copy_backward(F3Pool.begin() + drop.ind, F3Pool.begin() + cnt, F3Pool.begin() + cnt + 1);
+        F3Pool[drop.ind] = drop.pack;
+        ++cnt;
+    }
+
+    assert(cnt == prev.packCnt);
+
+    for (auto i = 0; i != cnt; ++i) {
+        F3Pack &pack = F3Pool[i];
+
+        rec.renju && pack.piece == BLACK ? pack.update<RENJU, S>(*this) : pack.update<FREESTYLE, S>(*this);
+    }
+}
+
+template <int S>
+template <Rule R>
+void Board<S>::update_material_see(Move m) {
     // Reset materialInc. Make material array, score array, F3 stack and B4d stack grow.
     materialInc.fill(0);
     F3FormedCnt.fill(0);
     material[pieceCnt] = material[pieceCnt - 1];
     score[pieceCnt]    = score[pieceCnt - 1];
-    F3Stack[pieceCnt]  = F3Stack[pieceCnt - 1];
     B4dStack[pieceCnt] = B4dStack[pieceCnt - 1];
 
+    // Start the F3 record from the packs of the previous ply
+    F3Stack[pieceCnt]       = F3Stack[pieceCnt - 1];
+    F3Stack[pieceCnt].renju = R == RENJU;
+
     // Save related see array elements in see stack for restoring
     for (auto p = Piece(0); p != PIECE_NUM; ++p)
         for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
@@ -319,7 +531,7 @@ void Board::update_material_see(Move m) {
     // Substract old info on four directions
     for (auto p = Piece(0); p != PIECE_NUM; ++p)
         for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
-            line_update<DEC>(p, m, d, interval[p][index_of(m, d)][index_on(m, d)]);
+            line_update<R, DEC>(p, m, d, interval[p][index_of(m, d)][index_on(m, d)]);
 
     // Update vector board
     update_vectorBoard(m);
@@ -332,13 +544,13 @@ void Board::update_material_see(Move m) {
         iof = index_of(m, d);
         ion = index_on(m, d);
 
-        line_update<INC>(sideToMove, m, d, interval[sideToMove][iof][ion]);
+        line_update<R, INC>(sideToMove, m, d, interval[sideToMove][iof][ion]);
 
         tmpitv.init(interval[oppoToMove][iof][ion].begin(), ion);
-        line_update<INC>(oppoToMove, m, d, tmpitv);
+        line_update<R, INC>(oppoToMove, m, d, tmpitv);
 
         tmpitv.init(ion + 1, interval[oppoToMove][iof][ion].end());
-        line_update<INC>(oppoToMove, m, d, tmpitv);
+        line_update<R, INC>(oppoToMove, m, d, tmpitv);
     }
 
     // Add materialInc to material
@@ -347,17 +559,19 @@ void Board::update_material_see(Move m) {
             material[pieceCnt][p][i] += materialInc[p][i];
 
     // Update F3 packs
-    F3Packs_update();
+    F3Packs_update<R>();
 }
 
 // Copy the backup info in seeStack to the related see elements
-void Board::restore_see(Move m) {
+template <int S>
+void Board<S>::restore_see(Move m) {
     for (auto p = Piece(0); p != PIECE_NUM; ++p)
         for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
             see[p][index_of(m, d)] = seeStack[pieceCnt][p][d];
 }
 
-void Board::update_interval(Move m) {
+template <int S>
+void Board<S>::update_interval(Move m) {
     int iof, ion;
 
     for (auto d = Direction(0); d != DIRECTION_NUM; ++d) {
@@ -372,7 +586,8 @@ void Board::update_interval(Move m) {
     }
 }
 
-void Board::restore_interval(Move m) {
+template <int S>
+void Board<S>::restore_interval(Move m) {
     int iof, ion;
 
     for (auto d = Direction(0); d != DIRECTION_NUM; ++d) {
@@ -384,21 +599,39 @@ void Board::restore_interval(Move m) {
     }
 }
 
-void Board::update_movelist(Move m) {
-    mListStack[pieceCnt] = mListStack[pieceCnt - 1];
-    mListStack[pieceCnt].remove(m);
+// Update the move list and record the change in move list log
+template <int S>
+void Board<S>::update_movelist(Move m) {
+    MoveListRecord &rec = mListLog[pieceCnt];
+    int             sz;
+
+    rec.removedInd = mList.index_of(m);
+    mList.remove(m);
+    sz = mList.size();
 
     for (auto &i : N2)
         if (is_empty(m + i))
-            mListStack[pieceCnt].insert(m + i);
+            mList.insert(m + i);
+
+    rec.insertedCnt = mList.size() - sz;
 }
 
-// Update the board after making a move. Update order is critical.
-void Board::do_move(Move m) {
-    assert(is_ok(m));
-    assert(is_empty(m));
-    assert(0 <= pieceCnt && pieceCnt < MOVE_SIZE);
+// Revert the move list change recorded in move list log
+template <int S>
+void Board<S>::restore_movelist(Move m) {
+    const MoveListRecord &rec = mListLog[pieceCnt + 1];
+
+    for (auto i = 0; i != rec.insertedCnt; ++i)
+        mList.pop_back();
 
+    if (rec.removedInd >= 0)
+        mList.restore(m, rec.removedInd);
+}
+
+// Make the updates of the last move delayed until the next move. The side to move
+// must be the one after the last move.
+template <int S>
+void Board<S>::late_update() {
     // Late interval update
     if (pieceCnt > 0 && !updatedInterval[pieceCnt]) {
         switch_side_to_move();
@@ -412,11 +645,22 @@ void Board::do_move(Move m) {
         update_movelist(last_move(1));
         updatedMoveList[pieceCnt] = true;
     }
+}
+
+// Update the board after making a move. Update order is critical.
+template <int S>
+template <Rule R>
+void Board<S>::do_move(Move m) {
+    assert(is_ok(m, S));
+    assert(is_empty(m));
+    assert(0 <= pieceCnt && pieceCnt < MoveSize);
+
+    late_update();
 
     // Realtime update
     board[m]              = sideToMove;
     pieceList[pieceCnt++] = m;
-    update_material_see(m);
+    update_material_see<R>(m);
     // update_interval(m);
     // update_movelist(m);
     key ^= Zobrists[sideToMove][m];
@@ -427,9 +671,18 @@ void Board::do_move(Move m) {
     updatedMoveList[pieceCnt] = false;
 }
 
+// Board::do_move() without rule parameter dispatches to the instantiation of
+// the current rule. Search code should call the template version directly.
+template <int S>
+void Board<S>::do_move(Move m) {
+    Threads.rule == FREESTYLE ? do_move<FREESTYLE>(m) : Threads.rule == STANDARD ? do_move<STANDARD>(m) :
+                                                                                   do_move<RENJU>(m);
+}
+
 // Restore the board after taking a piece. Restore order is critical.
-void Board::undo_move() {
-    assert(0 < pieceCnt && pieceCnt <= MOVE_SIZE);
+template <int S>
+void Board<S>::undo_move() {
+    assert(0 < pieceCnt && pieceCnt <= MoveSize);
 
     switch_side_to_move();
     Move lastMove   = pieceList[--pieceCnt];
@@ -440,6 +693,13 @@ void Board::undo_move() {
     if (updatedInterval[pieceCnt + 1])
         restore_interval(lastMove);
 
+    if (updatedMoveList[pieceCnt + 1]) {
+        restore_movelist(lastMove);
+        updatedMoveList[pieceCnt + 1] = false;
+    }
+
+    F3Packs_restore();
+
     materialInc.fill(0);
     F3FormedCnt.fill(0);
     key ^= Zobrists[sideToMove][lastMove];
@@ -447,17 +707,19 @@ void Board::undo_move() {
 
 // Return the winning/losing/drawing piece if the game is already over. Return
 // PIECE_NONE if the game should continue.
-Piece Board::check_wld_already() const {
+template <int S>
+template <Rule R>
+Piece Board<S>::check_wld_already() const {
     if (query(BLACK, C5) > 0)
         return BLACK;
 
     if (query(WHITE, C5) > 0)
         return WHITE;
 
-    if (pieceCnt >= MOVE_SIZE)
+    if (pieceCnt >= MoveSize)
         return PIECE_DRAW;
 
-    if ((Threads.rule == RENJU) && (query(BLACK, C6) > 0 || query_inc(BLACK, F4) + query_inc(BLACK, B4) >= 2 || F3FormedCnt[BLACK] >= 2))
+    if (R == RENJU && (query(BLACK, C6) > 0 || query_inc(BLACK, F4) + query_inc(BLACK, B4) >= 2 || F3FormedCnt[BLACK] >= 2))
         return WHITE;
 
     return PIECE_NONE;
@@ -466,8 +728,10 @@ Piece Board::check_wld_already() const {
 // Return the winning/losing/drawing piece or PIECE_NONE by quiescence check.
 // If the return value is not PIECE_NONE, offset will be updated as the move
 // number to game over.
-Piece Board::check_wld(int &offset) const {
-    Piece p = check_wld_already();
+template <int S>
+template <Rule R>
+Piece Board<S>::check_wld(int &offset) const {
+    Piece p = check_wld_already<R>();
 
     if (p != PIECE_NONE) {
         offset = 0;
@@ -495,16 +759,71 @@ Piece Board::check_wld(int &offset) const {
     return PIECE_NONE;
 }
 
-// Return true if the move is foul
-bool Board::is_foul(Move m) {
+template <int S>
+Piece Board<S>::check_wld_already() const {
+    return Threads.rule == FREESTYLE ? check_wld_already<FREESTYLE>() : Threads.rule == STANDARD ? check_wld_already<STANDARD>() :
+                                                                                                   check_wld_already<RENJU>();
+}
+
+template <int S>
+Piece Board<S>::check_wld(int &offset) const {
+    return Threads.rule == FREESTYLE ? check_wld<FREESTYLE>(offset) : Threads.rule == STANDARD ? check_wld<STANDARD>(offset) :
+                                                                                                 check_wld<RENJU>(offset);
+}
+
+// Return true if the move is a foul of black. The see info of black decides most
+// moves without making them: a move promoting to C6 is a foul, and a move not
+// promoting to any four or three is not. The rest are judged by a trial move, and
+// the results are cached for the position, so that each is made once however many
+// times the position is asked.
+template <int S>
+bool Board<S>::is_foul(Move m) {
+    assert(is_ok(m, S));
+    assert(is_empty(m));
+
+    if (Threads.rule != RENJU)
+        return false;
+
+    uint32_t promotion = 0;
+
+    for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
+        promotion |= see[BLACK][index_of(m, d)][index_on(m, d)];
+
+    if (promotion & (1u << C6))
+        return true;
+
+    if (!(promotion & ((1u << F4) | (1u << B4) | (1u << F3))))
+        return false;
+
+    if (foulKey != key) {
+        foulKey = key;
+        foulTested.reset();
+        foulSquares.reset();
+    }
+
+    if (!foulTested.contains(m)) {
+        foulTested.insert(m);
+        if (is_foul_by_trial(m))
+            foulSquares.insert(m);
+    }
+
+    return foulSquares.contains(m);
+}
+
+// Judge the foul by making the move for black. The late updates are made before
+// switching the side, as they are made for the side of the last move.
+template <int S>
+bool Board<S>::is_foul_by_trial(Move m) {
     bool ret;
     bool needToSwitch = sideToMove != BLACK;
 
+    late_update();
+
     if (needToSwitch)
         switch_side_to_move();
 
-    do_move(m);
-    ret = (Threads.rule == RENJU) && (query(BLACK, C6) > 0 || query_inc(BLACK, F4) + query_inc(BLACK, B4) >= 2 || F3FormedCnt[BLACK] >= 2) ? true : false;
+    do_move<RENJU>(m);
+    ret = query(BLACK, C6) > 0 || query_inc(BLACK, F4) + query_inc(BLACK, B4) >= 2 || F3FormedCnt[BLACK] >= 2;
     undo_move();
 
     if (needToSwitch)
@@ -513,15 +832,41 @@ bool Board::is_foul(Move m) {
     return ret;
 }
 
+// pattern_init() maps the pattern tables from the binary files in dir, so that
+// the tables can be changed without compiling and all engine processes share
+// one copy of them. The embedded tables are kept for the missing or invalid
+// files. Without embedded tables the files of the 15x15 board are required,
+// while the 20x20 board is only unavailable without its table.
+void pattern_init(const std::string &dir) {
+    for (auto t : {PATTERN_15F, PATTERN_15S, PATTERN_20F}) {
+        const std::string path = dir + PatternFile[t];
+
+        if (map_pattern_file(t, path))
+            sync_cout << "MESSAGE pattern table mapped from " << path << sync_endl;
+
+        else if (!Patterns[t].rows && t != PATTERN_20F) {
+            sync_cout << "ERROR pattern table " << path << " is missing or invalid" << sync_endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// pattern_available() returns true if the pattern tables of the board side are
+// available, either embedded or mapped from the files
+bool pattern_available(int side) {
+    return side == 20 ? Patterns[PATTERN_20F].rows != nullptr : side == 15;
+}
+
 // Generate helper tables. Must be called once before reset the board.
-void Board::table_init() {
+template <int S>
+void Board<S>::table_init() {
     // Calculate index of and index on table. They must be generated at first
     // or some other tables will not be initialized correctly.
     for (auto m = Move(0); m != MOVE_CAPACITY; ++m)
         for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
-            if (is_ok(m)) {
-                indexOfTable[m][d] = index_of_helper(m, d);
-                indexOnTable[m][d] = index_on_helper(m, d);
+            if (is_ok(m, S)) {
+                indexOfTable[m][d] = index_of_helper<S>(m, d);
+                indexOnTable[m][d] = index_on_helper<S>(m, d);
             }
 
     // Calculate see table
@@ -552,13 +897,19 @@ void Board::table_init() {
 }
 
 // Reset the board to empty status. The reset order is critical.
-void Board::reset() {
+template <int S>
+void Board<S>::reset() {
     // Reset member variables
     pieceCnt   = 0;
     sideToMove = BLACK;
     oppoToMove = ~sideToMove;
     key        = 0;
 
+    // Nothing is cached for the empty board
+    foulKey = key;
+    foulTested.reset();
+    foulSquares.reset();
+
     // Fill these arrays with zeros
     material.fill(0);
     score.fill(SCORE_ZERO);
@@ -567,46 +918,55 @@ void Board::reset() {
     updatedInterval.fill(0);
     updatedMoveList.fill(0);
 
-    // Reset the initial move list
-    mListStack[pieceCnt].reset();
+    // Reset the initial move list and F3 packs
+    mList.reset();
+    F3Stack[pieceCnt] = {0, 0, false};
 
     // Set board array according to the square type
     for (auto m = Move(0); m != MOVE_CAPACITY; ++m)
-        board[m] = is_ok(m) ? EMPTY : PIECE_OUT;
+        board[m] = is_ok(m, S) ? EMPTY : PIECE_OUT;
 
     // Initialize interval array
     for (auto p = Piece(0); p != PIECE_NUM; ++p)
         for (auto m = Move(0); m != MOVE_CAPACITY; ++m)
-            if (is_ok(m))
+            if (is_ok(m, S))
                 for (auto d = Direction(0); d != DIRECTION_NUM; ++d) {
                     interval[p][index_of(m, d)][index_on(m, d)].set_begin(0);
-                    interval[p][index_of(m, d)][index_on(m, d)].set_end(distance_between(start_of(m, d), end_of(m, d)) + 1);
+                    interval[p][index_of(m, d)][index_on(m, d)].set_end(distance_between(start_of<S>(m, d), end_of<S>(m, d)) + 1);
                 }
 
     // Initialize see array. This array must be initialized because it is non-empty
-    // even though there is no piece on the board.
+    // even though there is no piece on the board. A board without its pattern
+    // table is never played on, so it is left empty.
+    if (!pattern_available(S))
+        return;
+
     for (auto p = Piece(0); p != PIECE_NUM; ++p)
         for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
             for (Move m = Move(0); m != MOVE_CAPACITY; ++m)
-                if (is_ok(m))
-                    line_update<INC>(p, m, ~d, interval[p][index_of(m, ~d)][index_on(m, ~d)]);
+                if (is_ok(m, S)) {
+                    const Interval &itv = interval[p][index_of(m, ~d)][index_on(m, ~d)];
+                    Threads.rule == FREESTYLE ? line_update<FREESTYLE, INC>(p, m, ~d, itv) : Threads.rule == STANDARD ? line_update<STANDARD, INC>(p, m, ~d, itv) :
+                                                                                                                        line_update<RENJU, INC>(p, m, ~d, itv);
+                }
 
     updatedInterval[pieceCnt] = true;
     updatedMoveList[pieceCnt] = true;
 }
 
 // Print the board for test and debug.
-std::ostream &operator<<(std::ostream &os, Board &bd) {
+template <int S>
+std::ostream &operator<<(std::ostream &os, const Board<S> &bd) {
     // Display Board
-    for (auto r = 0; r != BOARD_SIDE; ++r) {
-        for (auto f = 0; f != BOARD_SIDE; ++f) {
+    for (auto r = 0; r != S; ++r) {
+        for (auto f = 0; f != S; ++f) {
             Move m = make_move(r, f);
 
             if (bd.board[m] == BLACK)
                 std::cout << "X";
             else if (bd.board[m] == WHITE)
                 std::cout << "O";
-            // else if (bd.mListStack[bd.pieceCnt].contains(m))
+            // else if (bd.mList.contains(m))
             //     std::cout << "*";
             // else if (bd.query<OPP, DEC>(WHITE, m, F3))
             //     std::cout << "*";
@@ -615,10 +975,10 @@ std::ostream &operator<<(std::ostream &os, Board &bd) {
 
             std::cout << " ";
         }
-        std::cout << BOARD_SIDE - r << std::endl;
+        std::cout << S - r << std::endl;
     }
 
-    for (auto i = 0; i != BOARD_SIDE; ++i)
+    for (auto i = 0; i != S; ++i)
         std::cout << std::left << std::setw(2) << static_cast<char>('A' + i) << std::right;
 
     // Display piece list
@@ -626,7 +986,7 @@ std::ostream &operator<<(std::ostream &os, Board &bd) {
               << bd.pieceCnt << (bd.pieceCnt < 2 ? " move " : " moves ");
 
     for (auto i = 0; i != bd.pieceCnt; ++i)
-        std::cout << bd.pieceList[i] << " ";
+        std::cout << move_to_string(bd.pieceList[i], S) << " ";
 
     // Display side to move
     std::cout << std::endl
@@ -646,3 +1006,24 @@ std::ostream &operator<<(std::ostream &os, Board &bd) {
 
     return os;
 }
+
+// Instantiations of the board of each side
+template class Board<15>;
+template class Board<20>;
+
+// Instantiations of the rule dependent functions called by search. GCC finds an
+// explicit instantiation of them ambiguous with the overloads dispatching on the
+// rule, so their addresses are taken instead.
+template <int S, Rule R>
+struct RuleInstance {
+    static constexpr void (Board<S>::*DoMove)(Move)          = &Board<S>::template do_move<R>;
+    static constexpr Piece (Board<S>::*CheckWld)(int &) const = &Board<S>::template check_wld<R>;
+};
+
+template struct RuleInstance<15, FREESTYLE>;
+template struct RuleInstance<15, STANDARD>;
+template struct RuleInstance<15, RENJU>;
+template struct RuleInstance<20, FREESTYLE>;
+
+template std::ostream &operator<<(std::ostream &os, const Board<15> &bd);
+template std::ostream &operator<<(std::ostream &os, const Board<20> &bd);
@@ -14,6 +14,7 @@
 #include "type.h"
 
 #include <array>
+#include <string>
 #include <vector>
 
 enum SideType { US,
@@ -21,6 +22,7 @@ enum SideType { US,
 enum Operation { INC,
                  DEC };
 
+template <int S>
 class Board;
 
 // NArray is a generic N-dimensional array. The first template parameter T is
@@ -80,13 +82,48 @@ struct F3Pack {
     int       vind;
     int       gen;
 
+    F3Pack() = default;
     F3Pack(Piece p, Move m, Direction d, int ind);
     bool valid() const;
-    template <Rule>
-    void update(const Board &bd);
+    template <Rule, int S>
+    void update(const Board<S> &bd);
+};
+
+// F3Packs struct is a view of the F3 packs of the current position, which are
+// stored in the F3 pack pool of the board.
+struct F3Packs {
+    const F3Pack *begin() const {
+        return first;
+    }
+    const F3Pack *end() const {
+        return last;
+    }
+
+    const F3Pack *first;
+    const F3Pack *last;
+};
+
+// MoveListRecord struct records how a move changed the move list, so that the
+// change can be reverted exactly
+struct MoveListRecord {
+    int16_t removedInd; // Index the move was removed from, -1 if not in list
+    int16_t insertedCnt;
 };
 
-typedef std::vector<F3Pack> F3Packs;
+// F3Record struct records the F3 packs after a move. The packs formed by the move
+// are the last ones of the pool, and the packs dropped by it are logged, so that
+// the packs of the ply before can be restored exactly.
+struct F3Record {
+    int16_t packCnt;
+    int16_t droppedEnd; // End of the dropped pack log
+    bool    renju;      // Black packs are updated with renju rule
+};
+
+// F3Drop struct is an F3 pack dropped by a move and the index it was dropped from
+struct F3Drop {
+    F3Pack pack;
+    int    ind;
+};
 
 inline F3Pack::F3Pack(Piece p, Move m, Direction d, int ind) {
     piece     = p;
@@ -107,13 +144,31 @@ inline bool operator==(const F3Pack &lhs, const F3Pack &rhs) {
 }
 
 // Board class is the most important class, storing all necessary information
-// for board operations in searching and game playing
+// for board operations in searching and game playing. The board side S is a
+// template parameter, so that the array sizes and loop bounds are constants for
+// each supported side.
+template <int S>
 class Board {
-    friend std::ostream &operator<<(std::ostream &os, Board &bd);
+    template <int Side>
+    friend std::ostream &operator<<(std::ostream &os, const Board<Side> &bd);
     friend struct F3Pack;
+    template <int Side>
     friend class MoveGen;
+    friend struct MicroBench;
 
 public:
+    static constexpr int MoveSize   = S * S;
+    static constexpr int StackSize  = MoveSize + 1;
+    static constexpr int VectorSize = S * 6 - 2;
+    // Packs of a position are unique per piece and line, and a move forms packs
+    // only on its own lines, at most one per piece and direction. Each dropped
+    // pack was formed by a move on the stack, so neither array can overflow.
+    static constexpr int F3PoolSize = PIECE_NUM * VectorSize;
+    static constexpr int F3DropSize = MoveSize * PIECE_NUM * DIRECTION_NUM;
+
+    static_assert(VectorSize == S * 2 + (S * 2 - 1) * 2, "one line vector per rank, file and diagonal");
+    static_assert(F3PoolSize <= INT16_MAX && F3DropSize <= INT16_MAX, "F3Record fields overflow");
+
     Board();
     Board(const Board &bd);
     Board &operator=(const Board &bd);
@@ -135,14 +190,21 @@ public:
     int  query(Piece p, Move m, Material mat) const;
     bool is_quiet() const;
     bool is_quiet(Move m) const;
+    F3Packs F3_packs() const;
 
     Score see_of(Move m) const;
     Score evaluate() const;
 
+    template <Rule>
+    void do_move(Move m);
     void do_move(Move m);
     void undo_move();
 
+    template <Rule>
+    Piece check_wld_already() const;
     Piece check_wld_already() const;
+    template <Rule>
+    Piece check_wld(int &offset) const;
     Piece check_wld(int &offset) const;
     bool  is_foul(Move m);
 
@@ -164,76 +226,106 @@ private:
     int  index_on(Move m, Direction d) const;
     void update_vectorBoard(Move m);
     void restore_vectorBoard(Move m);
+    template <Rule>
     void update_material_see(Move m);
     void restore_see(Move m);
     void update_interval(Move m);
     void restore_interval(Move m);
     void update_movelist(Move m);
+    void restore_movelist(Move m);
+    void late_update();
 
     // Low level helpers
     int  query_vectorBoard(Piece p, int vind, const Interval &itv) const;
     bool query_see(Piece p, int vind, int sind, uint32_t mask) const;
-    template <Operation>
+    template <Rule, Operation>
     void line_update(Piece p, Move m, Direction d, const Interval &itv);
+    template <Rule>
     void F3Packs_update();
+    void F3Packs_restore();
     void table_init();
+    void copy_from(const Board &bd);
+    bool is_foul_by_trial(Move m);
 
     // Multi-dimensional array members
-    NArray<Move, MOVE_SIZE>                                            pieceList;
-    NArray<Piece, MOVE_CAPACITY>                                       board;
-    NArray<int16_t, PIECE_NUM, MATERIAL_NUM>                           materialInc;
-    NArray<int16_t, STACK_SIZE, PIECE_NUM, MATERIAL_NUM>               material;
-    NArray<Score, STACK_SIZE, PIECE_NUM>                               score;
-    NArray<uint32_t, STACK_SIZE, PIECE_NUM, DIRECTION_NUM, BOARD_SIDE> seeStack;
-    NArray<uint32_t, PIECE_NUM, VECTOR_SIZE, BOARD_SIDE>               see;
-    NArray<uint32_t, PIECE_NUM, VECTOR_SIZE>                           vectorBoard;
-    NArray<Interval, PIECE_NUM, VECTOR_SIZE, BOARD_SIDE>               interval;
-    NArray<MoveList<Move>, STACK_SIZE>                                 mListStack;
-    NArray<F3Packs, STACK_SIZE>                                        F3Stack;
-    NArray<Move, STACK_SIZE>                                           B4dStack;
-    NArray<bool, STACK_SIZE>                                           updatedInterval;
-    NArray<bool, STACK_SIZE>                                           updatedMoveList;
-    NArray<int, PIECE_NUM>                                             F3FormedCnt;
+    NArray<Move, MoveSize>                                   pieceList;
+    NArray<Piece, MOVE_CAPACITY>                             board;
+    NArray<int16_t, PIECE_NUM, MATERIAL_NUM>                 materialInc;
+    NArray<int16_t, StackSize, PIECE_NUM, MATERIAL_NUM>      material;
+    NArray<Score, StackSize, PIECE_NUM>                      score;
+    NArray<uint32_t, StackSize, PIECE_NUM, DIRECTION_NUM, S> seeStack;
+    NArray<uint32_t, PIECE_NUM, VectorSize, S>               see;
+    NArray<uint32_t, PIECE_NUM, VectorSize>                  vectorBoard;
+    NArray<Interval, PIECE_NUM, VectorSize, S>               interval;
+    MoveList<Move, S>                                        mList;
+    NArray<MoveListRecord, StackSize>                        mListLog;
+    NArray<F3Pack, F3PoolSize>                               F3Pool;
+    NArray<F3Drop, F3DropSize>                               F3Dropped;
+    NArray<F3Record, StackSize>                              F3Stack;
+    NArray<Move, StackSize>                                  B4dStack;
+    NArray<bool, StackSize>                                  updatedInterval;
+    NArray<bool, StackSize>                                  updatedMoveList;
+    NArray<int, PIECE_NUM>                                   F3FormedCnt;
+
+    // Foul cache of the position of foulKey
+    ZobristKey foulKey;
+    BitBoard   foulTested;
+    BitBoard   foulSquares;
+
+    // Move lists of the move generators, not copied with the board
+    MoveStack<S> moveStack;
 
     bool       tableGenerated = false;
     std::mutex mutex;
 };
 
-std::ostream &operator<<(std::ostream &os, const Board &bd);
+template <int S>
+std::ostream &operator<<(std::ostream &os, const Board<S> &bd);
 
-inline bool Board::is_empty() const {
+void pattern_init(const std::string &dir);
+bool pattern_available(int side);
+
+template <int S>
+inline bool Board<S>::is_empty() const {
     return pieceCnt == 0;
 }
 
-inline bool Board::is_empty(Move m) const {
+template <int S>
+inline bool Board<S>::is_empty(Move m) const {
     return board[m] == EMPTY;
 }
 
-inline Move Board::last_move(int n) const {
+template <int S>
+inline Move Board<S>::last_move(int n) const {
     assert(pieceCnt >= n);
 
     return pieceList[pieceCnt - n];
 }
 
-inline Move Board::defend_B4() const {
+template <int S>
+inline Move Board<S>::defend_B4() const {
     return B4dStack[pieceCnt];
 }
 
-inline void Board::switch_side_to_move() {
+template <int S>
+inline void Board<S>::switch_side_to_move() {
     sideToMove = ~sideToMove;
     oppoToMove = ~oppoToMove;
 }
 
-inline int Board::query(Piece p, Material m) const {
+template <int S>
+inline int Board<S>::query(Piece p, Material m) const {
     return material[pieceCnt][p][m];
 }
 
-inline int Board::query_inc(Piece p, Material m) const {
+template <int S>
+inline int Board<S>::query_inc(Piece p, Material m) const {
     return materialInc[p][m];
 }
 
-inline int Board::query_vcf(Piece p, Move m) const {
-    assert(is_ok(m));
+template <int S>
+inline int Board<S>::query_vcf(Piece p, Move m) const {
+    assert(is_ok(m, S));
 
     int ret = 0;
 
@@ -243,42 +335,45 @@ inline int Board::query_vcf(Piece p, Move m) const {
     return ret;
 }
 
-template <>
-inline int Board::query<US, INC>(Piece p, Move m, Material mat) const {
-    assert(is_ok(m));
-    assert(C6 <= mat && mat <= B1);
+// Board::query<US, INC>() returns the number of promotions of the material if
+// the piece is put at m. Board::query<OPP, DEC>() returns the number of demotions
+// of the material of the opponent of the piece if the piece is put at m.
+template <int S>
+template <SideType ST, Operation O>
+inline int Board<S>::query(Piece p, Move m, Material mat) const {
+    static_assert((ST == US && O == INC) || (ST == OPP && O == DEC), "unsupported query");
+    assert(is_ok(m, S));
+    assert(ST == US ? C6 <= mat && mat <= B1 : B4 <= mat && mat <= B1);
 
     int ret = 0;
 
     for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
-        ret += query_see(p, index_of(m, d), index_on(m, d), 1u << mat);
+        if constexpr (ST == US)
+            ret += query_see(p, index_of(m, d), index_on(m, d), 1u << mat);
+        else
+            ret += query_see(~p, index_of(m, d), index_on(m, d), 1u << (mat + 21));
 
     return ret;
 }
 
-template <>
-inline int Board::query<OPP, DEC>(Piece p, Move m, Material mat) const {
-    assert(is_ok(m));
-    assert(B4 <= mat && mat <= B1);
-
-    int ret = 0;
-
-    for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
-        ret += query_see(~p, index_of(m, d), index_on(m, d), 1u << (mat + 21));
-
-    return ret;
-}
-
-inline bool Board::is_quiet() const {
+template <int S>
+inline bool Board<S>::is_quiet() const {
     return query(BLACK, B4) || query(BLACK, F3) || query(WHITE, B4) || query(WHITE, F3) ? false : true;
 }
 
-inline bool Board::is_quiet(Move m) const {
+template <int S>
+inline bool Board<S>::is_quiet(Move m) const {
     return query<US, INC>(sideToMove, m, B4) || query<US, INC>(sideToMove, m, F3) ? false : true;
 }
 
+template <int S>
+inline F3Packs Board<S>::F3_packs() const {
+    return {F3Pool.data(), F3Pool.data() + F3Stack[pieceCnt].packCnt};
+}
+
 // Return see value of the move.
-inline Score Board::see_of(Move m) const {
+template <int S>
+inline Score Board<S>::see_of(Move m) const {
     Score ret = SCORE_ZERO;
 
     for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
@@ -288,32 +383,39 @@ inline Score Board::see_of(Move m) const {
 }
 
 // Return static evaluation for side to move
-inline Score Board::evaluate() const {
+template <int S>
+inline Score Board<S>::evaluate() const {
     return pieceCnt > 0 ? (score[pieceCnt][sideToMove] - score[pieceCnt][oppoToMove] + score[pieceCnt - 1][sideToMove] - score[pieceCnt - 1][oppoToMove]) / 2 : SCORE_ZERO;
 }
 
-inline int Board::index_of(Move m, Direction d) const {
+template <int S>
+inline int Board<S>::index_of(Move m, Direction d) const {
     return indexOfTable[m][d];
 }
 
-inline int Board::index_on(Move m, Direction d) const {
+template <int S>
+inline int Board<S>::index_on(Move m, Direction d) const {
     return indexOnTable[m][d];
 }
 
-inline void Board::update_vectorBoard(Move m) {
+template <int S>
+inline void Board<S>::update_vectorBoard(Move m) {
     for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
         set_bit<uint32_t>(vectorBoard[sideToMove][index_of(m, d)], index_on(m, d));
 }
 
-inline void Board::restore_vectorBoard(Move m) {
+template <int S>
+inline void Board<S>::restore_vectorBoard(Move m) {
     for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
         reset_bit<uint32_t>(vectorBoard[sideToMove][index_of(m, d)], index_on(m, d));
 }
 
-inline int Board::query_vectorBoard(Piece p, int vind, const Interval &itv) const {
+template <int S>
+inline int Board<S>::query_vectorBoard(Piece p, int vind, const Interval &itv) const {
     return get_bits<uint32_t>(vectorBoard[p][vind], itv.begin(), itv.end());
 }
 
-inline bool Board::query_see(Piece p, int vind, int sind, uint32_t mask) const {
+template <int S>
+inline bool Board<S>::query_see(Piece p, int vind, int sind, uint32_t mask) const {
     return see[p][vind][sind] & mask;
 }
@@ -0,0 +1,300 @@
+/*      _____                __    ______
+ *     / ___ \              / /   /___  /
+ *    / /__/ /___  ____  __/ /_______/ /    ____  ____
+ *   / _____/ __ \/ __ \/_   _/ __  / /    / __ \/ __ \
+ *  / /    /  ___/ / / / / /_/ /_/ / /____/  ___/ / / /
+ * /_/     \____/_/ /_/ /___/\__,_/______/\____/_/ /_/
+ *
+ * PentaZen, a Gomoku/Renju playing engine developed by Sun Yuliang.
+ */
+
+#include "dfpn.h"
+
+#include "movegen.h"
+#include "thread.h"
+
+#include <algorithm>
+
+// DfpnTable::resize() sets the size of the table, measured in megabytes
+void DfpnTable::resize(size_t mbSize) {
+    table.assign(mbSize * 1024 * 1024 / sizeof(Cluster), Cluster());
+    used = 0;
+}
+
+// DfpnTable::clear() removes all entries
+void DfpnTable::clear() {
+    std::fill(table.begin(), table.end(), Cluster());
+    used = 0;
+}
+
+// DfpnTable::probe() returns the entry of the position, or nullptr if not found
+const DfpnEntry *DfpnTable::probe(ZobristKey key) const {
+    const Cluster &c = table[mul_hi64(key, table.size())];
+
+    for (auto &e : c.entry)
+        if (e.work && e.key == key)
+            return &e;
+
+    return nullptr;
+}
+
+// DfpnTable::save() stores the entry of the position. The entry of the same
+// position is overwritten, otherwise an empty entry or the one with the least
+// work in the cluster is replaced.
+void DfpnTable::save(ZobristKey key, uint32_t pn, uint32_t dn, uint32_t work, Move m) {
+    Cluster &  c       = table[mul_hi64(key, table.size())];
+    DfpnEntry *replace = nullptr;
+
+    for (auto &e : c.entry)
+        if (e.work && e.key == key)
+            replace = &e;
+
+    if (!replace) {
+        replace = &c.entry[0];
+        for (auto &e : c.entry)
+            if (e.work < replace->work)
+                replace = &e;
+
+        if (!replace->work)
+            ++used;
+    }
+
+    *replace = {key, pn, dn, std::max(work, 1u), m};
+
+    // Collect garbage if the table is nearly full
+    if (used > table.size() * ClusterSize * 9 / 10)
+        gc();
+}
+
+// DfpnTable::gc() removes the entries of the smallest subtrees until half of the
+// table is free. The work threshold is doubled after each pass.
+void DfpnTable::gc() {
+    const size_t target = table.size() * ClusterSize / 2;
+
+    for (uint64_t w = 1; used > target; w *= 2)
+        for (auto &c : table)
+            for (auto &e : c.entry)
+                if (e.work && e.work <= w) {
+                    e.work = 0;
+                    --used;
+                }
+}
+
+template <int S>
+DfpnSolver<S>::DfpnSolver() {
+    table.resize(TableSize);
+}
+
+// DfpnSolver::solve() tries to prove a win or a loss of the side to move of the
+// root board within the given time in milliseconds. The proof line is the main
+// line of the proof tree if any.
+template <int S>
+SolveResult DfpnSolver<S>::solve(const Board<S> &root, TimePoint time) {
+    bd           = std::make_unique<Board<S>>(root);
+    deadline     = now() + time;
+    stop         = false;
+    nodeCnt      = 0;
+    proofLine[0] = MOVE_NONE;
+
+    // The 20x20 board is played with freestyle only
+    if constexpr (S == 20)
+        return solve<FREESTYLE>();
+    else
+        return Threads.rule == FREESTYLE ? solve<FREESTYLE>() : Threads.rule == STANDARD ? solve<STANDARD>() :
+                                                                                           solve<RENJU>();
+}
+
+template <int S>
+template <Rule R>
+SolveResult DfpnSolver<S>::solve() {
+    const DfpnEntry *e;
+
+    // Prove that side to move wins by threats
+    attacker = bd->sideToMove;
+    table.clear();
+    mid<R>(PN_INF, PN_INF, true);
+
+    if ((e = table.probe(bd->key)) && e->pn == 0) {
+        extract_proof_line<R>(true);
+        return SOLVE_WIN;
+    }
+
+    // Prove that opponent wins by threats against every move
+    attacker = bd->oppoToMove;
+    table.clear();
+    mid<R>(PN_INF, PN_INF, true);
+
+    if ((e = table.probe(bd->key)) && e->pn == 0) {
+        extract_proof_line<R>(true);
+        return SOLVE_LOSS;
+    }
+
+    return SOLVE_UNKNOWN;
+}
+
+// DfpnSolver::mid() expands the node until its proof number or disproof number
+// reaches the threshold. It is written in the phi/delta form: phi is the proof
+// number at OR nodes (attacker to move) and the disproof number at AND nodes,
+// and delta is the other one.
+template <int S>
+template <Rule R>
+void DfpnSolver<S>::mid(uint32_t thpn, uint32_t thdn, bool rootNode) {
+    if (stop)
+        return;
+
+    // Check timeout
+    if ((++nodeCnt & 1023u) == 0 && now() > deadline) {
+        stop = true;
+        return;
+    }
+
+    const ZobristKey key      = bd->key;
+    const bool       orNode   = bd->sideToMove == attacker;
+    const uint64_t   startCnt = nodeCnt;
+    const DfpnEntry *e        = table.probe(key);
+    const uint32_t   work     = e ? e->work : 0;
+    Move             moves[Board<S>::MoveSize];
+    Piece            piece;
+    int              offset, moveNum, bestIdx;
+    uint32_t         phi, delta, thphi, thdelta, cphi, cdelta, cphiBest, delta2;
+    uint64_t         sum;
+
+    // Return if already proven or disproven
+    if (e && (e->pn == 0 || e->dn == 0))
+        return;
+
+    // Proven if attacker wins, otherwise disproven
+    if ((piece = bd->template check_wld<R>(offset)) != PIECE_NONE) {
+        piece == attacker ? table.save(key, 0, PN_INF, 1, MOVE_NONE) : table.save(key, PN_INF, 0, 1, MOVE_NONE);
+        return;
+    }
+
+    moveNum = generate(moves, rootNode);
+
+    // Disproven if attacker has no threat
+    if (moveNum == 0) {
+        table.save(key, PN_INF, 0, 1, MOVE_NONE);
+        return;
+    }
+
+    thphi   = orNode ? thpn : thdn;
+    thdelta = orNode ? thdn : thpn;
+    bestIdx = 0;
+
+    while (true) {
+        // Phi is the least delta of children and delta is the sum of phi of
+        // children. Children not in the table count as one.
+        phi      = PN_INF;
+        delta2   = PN_INF;
+        cphiBest = 1;
+        sum      = 0;
+
+        for (auto i = 0; i != moveNum; ++i) {
+            const DfpnEntry *ce = table.probe(bd->key_after(moves[i]));
+
+            cphi   = ce ? (orNode ? ce->dn : ce->pn) : 1;
+            cdelta = ce ? (orNode ? ce->pn : ce->dn) : 1;
+            sum += cphi;
+
+            if (cdelta < phi) {
+                delta2   = phi;
+                phi      = cdelta;
+                cphiBest = cphi;
+                bestIdx  = i;
+            } else if (cdelta < delta2)
+                delta2 = cdelta;
+        }
+
+        delta = uint32_t(std::min(sum, uint64_t(PN_INF)));
+
+        if (phi >= thphi || delta >= thdelta || stop)
+            break;
+
+        // Search the best child with thresholds so that it returns as soon as
+        // another child becomes better or the node reaches its threshold
+        const uint32_t cthphi   = uint32_t(std::min(uint64_t(thdelta) + cphiBest - delta, uint64_t(PN_INF)));
+        const uint32_t cthdelta = std::min(thphi, delta2 + 1);
+
+        bd->template do_move<R>(moves[bestIdx]);
+        orNode ? mid<R>(cthdelta, cthphi, false) : mid<R>(cthphi, cthdelta, false);
+        bd->undo_move();
+    }
+
+    table.save(key, orNode ? phi : delta, orNode ? delta : phi, uint32_t(std::min(work + nodeCnt - startCnt, uint64_t(UINT32_MAX))), moves[bestIdx]);
+}
+
+// DfpnSolver::extract_proof_line() follows the proof tree from the root. The
+// attacker plays the proof move and the defender plays the defence with the
+// largest proof tree. Moves to finish the game are appended at the end.
+template <int S>
+template <Rule R>
+void DfpnSolver<S>::extract_proof_line(bool rootNode) {
+    const DfpnEntry *e, *ce;
+    Move             moves[Board<S>::MoveSize];
+    Move             m;
+    uint32_t         work;
+    int              offset, moveNum, cnt = 0;
+
+    while (cnt < int(proofLine.size()) - 1 && (e = table.probe(bd->key)) && e->pn == 0 && bd->template check_wld<R>(offset) == PIECE_NONE) {
+        m = e->move;
+
+        if (bd->sideToMove != attacker) {
+            moveNum = generate(moves, rootNode);
+            work    = 0;
+
+            for (auto i = 0; i != moveNum; ++i)
+                if ((ce = table.probe(bd->key_after(moves[i]))) && ce->pn == 0 && ce->work >= work) {
+                    m    = moves[i];
+                    work = ce->work;
+                }
+        }
+
+        if (m == MOVE_NONE)
+            break;
+
+        proofLine[cnt++] = m;
+        bd->template do_move<R>(m);
+        rootNode = false;
+    }
+
+    // Finish the game
+    while (cnt < int(proofLine.size()) - 1 && bd->template check_wld<R>(offset) != PIECE_NONE && offset > 0) {
+        MoveGen<S> mg(bd.get());
+
+        proofLine[cnt++] = m = mg.template generate<WLD>().move;
+        bd->template do_move<R>(m);
+    }
+
+    proofLine[cnt] = MOVE_NONE;
+
+    while (cnt--)
+        bd->undo_move();
+}
+
+// DfpnSolver::generate() lists the moves of the current node and returns the
+// number of them. Attacker forms threats and defender defends the threats. At
+// the root of a loss proof the defender tries every empty square instead, as a
+// stone away from the others may still block a threat later in the line.
+template <int S>
+int DfpnSolver<S>::generate(Move *moves, bool rootNode) {
+    int n = 0;
+
+    if (rootNode && bd->sideToMove != attacker) {
+        for (auto r = 0; r != S; ++r)
+            for (auto f = 0; f != S; ++f)
+                if (bd->is_empty(make_move(r, f)))
+                    moves[n++] = make_move(r, f);
+    } else {
+        MoveGen<S> mg(bd.get(), bd->sideToMove == attacker ? VCT_TT : VCT_DEFEND_TT, MOVE_NONE, true);
+        ExtMove    em;
+
+        while ((em = mg.next_move()).move != MOVE_NONE)
+            moves[n++] = em.move;
+    }
+
+    return n;
+}
+
+// Instantiations of the solver of each side
+template class DfpnSolver<15>;
+template class DfpnSolver<20>;
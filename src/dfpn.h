@@ -0,0 +1,94 @@
+/*      _____                __    ______
+ *     / ___ \              / /   /___  /
+ *    / /__/ /___  ____  __/ /_______/ /    ____  ____
+ *   / _____/ __ \/ __ \/_   _/ __  / /    / __ \/ __ \
+ *  / /    /  ___/ / / / / /_/ /_/ / /____/  ___/ / / /
+ * /_/     \____/_/ /_/ /___/\__,_/______/\____/_/ /_/
+ *
+ * PentaZen, a Gomoku/Renju playing engine developed by Sun Yuliang.
+ */
+
+#pragma once
+
+#include "board.h"
+#include "search.h"
+
+#include <memory>
+#include <vector>
+
+// Proof and disproof numbers are saturated at PN_INF
+constexpr uint32_t PN_INF = 0x3FFFFFFF;
+
+// DfpnEntry struct is the DF-PN table entry. Besides proof and disproof numbers,
+// it keeps the best move and the number of nodes searched below the node, which
+// decides the entries to replace and to collect. Zero work means empty.
+struct DfpnEntry {
+    ZobristKey key;
+    uint32_t   pn, dn;
+    uint32_t   work;
+    Move       move;
+};
+
+// DfpnTable class is a hash table of DfpnEntry with a fixed size. Each cluster
+// holds ClusterSize entries and a new entry replaces the one with the least
+// work. When the table is nearly full, gc() removes the entries of the smallest
+// subtrees, so that the solver always runs in bounded memory.
+class DfpnTable {
+    static constexpr int ClusterSize = 4;
+
+    struct Cluster {
+        DfpnEntry entry[ClusterSize];
+    };
+
+public:
+    void resize(size_t mbSize);
+    void clear();
+
+    const DfpnEntry *probe(ZobristKey key) const;
+    void             save(ZobristKey key, uint32_t pn, uint32_t dn, uint32_t work, Move m);
+
+private:
+    void gc();
+
+    std::vector<Cluster> table;
+    size_t               used;
+};
+
+enum SolveResult {
+    SOLVE_UNKNOWN,
+    SOLVE_WIN,
+    SOLVE_LOSS
+};
+
+// DfpnSolver class proves a win or a loss of the side to move with depth-first
+// proof-number search. The attacker plays threats to form B4 or F3, and the
+// defender tries every defence given by the threat generators of MoveGen. A
+// loss is proven if the opponent wins so against every empty square the side to
+// move can play.
+template <int S>
+class DfpnSolver {
+public:
+    static constexpr size_t TableSize = 64; // In megabytes
+
+    DfpnSolver();
+
+    SolveResult solve(const Board<S> &root, TimePoint time);
+
+    Pv       proofLine;
+    uint64_t nodeCnt;
+
+private:
+    template <Rule R>
+    SolveResult solve();
+    template <Rule R>
+    void mid(uint32_t thpn, uint32_t thdn, bool rootNode);
+    template <Rule R>
+    void extract_proof_line(bool rootNode);
+    int  generate(Move *moves, bool rootNode);
+
+    std::unique_ptr<Board<S>> bd;
+    DfpnTable                 table;
+    Piece                     attacker;
+    TimePoint                 deadline;
+    bool                      stop;
+};
@@ -10,8 +10,8 @@
 
 #include "protocol.h"
 
-int main() {
-    loop();
+int main(int argc, char *argv[]) {
+    loop(argc, argv);
 
     return 0;
 }
@@ -0,0 +1,289 @@
+/*      _____                __    ______
+ *     / ___ \              / /   /___  /
+ *    / /__/ /___  ____  __/ /_______/ /    ____  ____
+ *   / _____/ __ \/ __ \/_   _/ __  / /    / __ \/ __ \
+ *  / /    /  ___/ / / / / /_/ /_/ / /____/  ___/ / / /
+ * /_/     \____/_/ /_/ /___/\__,_/______/\____/_/ /_/
+ *
+ * PentaZen, a Gomoku/Renju playing engine developed by Sun Yuliang.
+ */
+
+// Microbenchmark program timing the hot primitives of the engine in isolation.
+// Usage: microbench [rule = 0] [positions = 200] [trials = 10] [side = 15]
+
+#include "movegen.h"
+#include "thread.h"
+#include "tt.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <vector>
+
+typedef std::vector<Move> Position;
+
+// MicroBench struct has access to the board internals, so that the parts of
+// Board::do_move() can be timed one by one
+struct MicroBench {
+    template <int S>
+    static const MoveList<Move, S> &move_list(const Board<S> &bd) {
+        return bd.mList;
+    }
+
+    template <Rule R, int S>
+    static void F3Packs_update(Board<S> &bd) {
+        bd.template F3Packs_update<R>();
+    }
+
+    // Late updates are made for the last move with the side of the last move
+    template <int S>
+    static void update_restore_interval(Board<S> &bd) {
+        bd.switch_side_to_move();
+        bd.update_interval(bd.last_move(1));
+        bd.restore_interval(bd.last_move(1));
+        bd.switch_side_to_move();
+    }
+
+    // Movelist log is read at one ply above by restore_movelist()
+    template <int S>
+    static void update_restore_movelist(Board<S> &bd) {
+        bd.update_movelist(bd.last_move(1));
+        --bd.pieceCnt;
+        bd.restore_movelist(bd.pieceList[bd.pieceCnt]);
+        ++bd.pieceCnt;
+    }
+};
+
+namespace {
+
+// Stats of one timed operation over all trials, in ns per operation
+struct OpStats {
+    std::string         name;
+    std::vector<double> samples;
+    uint64_t            ops;
+
+    void print() const {
+        double mean = 0, var = 0;
+
+        for (auto s : samples)
+            mean += s;
+        mean /= samples.size();
+
+        for (auto s : samples)
+            var += (s - mean) * (s - mean);
+        var /= samples.size();
+
+        std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << mean << std::setw(10) << std::sqrt(var)
+                  << std::setw(10) << *std::min_element(samples.begin(), samples.end())
+                  << std::setw(12) << ops << std::endl;
+    }
+};
+
+typedef std::chrono::steady_clock Clock;
+
+inline double ns_between(Clock::time_point a, Clock::time_point b) {
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count());
+}
+
+// Generate positions by playing one of the best four moves of MoveGen at random
+// from the empty board. Positions where the game is over are dropped.
+template <int S>
+std::vector<Position> generate_positions(int cnt) {
+    std::vector<Position> positions;
+    PRNG                  rng(20211201);
+    auto                  bd = std::make_unique<Board<S>>();
+
+    while (int(positions.size()) < cnt) {
+        const int len = 8 + rng.rand<unsigned>() % 33;
+        Position  pos;
+
+        bd->reset();
+        bd->do_move(make_move(S / 2, S / 2));
+        pos.push_back(make_move(S / 2, S / 2));
+
+        while (int(pos.size()) < len && bd->check_wld_already() == PIECE_NONE) {
+            MoveGen<S> mg(bd.get());
+            ExtMove    em[4];
+            int        n = 0;
+
+            while (n < 4 && (em[n] = mg.next_move()).move != MOVE_NONE)
+                ++n;
+
+            pos.push_back(em[rng.rand<unsigned>() % n].move);
+            bd->do_move(pos.back());
+        }
+
+        if (bd->check_wld_already() == PIECE_NONE)
+            positions.push_back(pos);
+    }
+
+    return positions;
+}
+
+// Time an operation on every position. The setup of a position is not timed and
+// makes the late updates of the last move unless the operation times them. Op
+// returns the number of operations done on the board.
+template <int S, typename Op>
+OpStats run(const std::string &name, const std::vector<Position> &positions, int trials, bool lateUpdate, Op op) {
+    OpStats stats{name, {}, 0};
+    auto    bd = std::make_unique<Board<S>>();
+
+    for (auto t = 0; t != trials; ++t) {
+        double   ns  = 0;
+        uint64_t ops = 0;
+
+        for (auto &pos : positions) {
+            bd->reset();
+            for (auto m : pos)
+                bd->do_move(m);
+
+            // Make late updates of the last move before timing
+            if (lateUpdate) {
+                MoveGen<S> mg(bd.get());
+                bd->do_move(*MicroBench::move_list(*bd).begin());
+                bd->undo_move();
+            }
+
+            Clock::time_point start = Clock::now();
+            ops += op(*bd);
+            ns += ns_between(start, Clock::now());
+        }
+
+        stats.samples.push_back(ns / ops);
+        stats.ops = ops;
+    }
+
+    return stats;
+}
+
+template <int S, Rule R>
+void bench_board(const std::vector<Position> &positions, int trials) {
+    volatile int sink = 0;
+
+    // Move list is not changed by the pairs after late updates
+    run<S>("do_move + undo_move", positions, trials, true, [](Board<S> &bd) {
+        uint64_t n = 0;
+        for (auto m : MicroBench::move_list(bd)) {
+            bd.template do_move<R>(m);
+            bd.undo_move();
+            ++n;
+        }
+        return n;
+    }).print();
+
+    run<S>("  F3Packs_update", positions, trials, true, [](Board<S> &bd) {
+        MicroBench::F3Packs_update<R, S>(bd);
+        return 1;
+    }).print();
+
+    run<S>("  update/restore_interval", positions, trials, false, [](Board<S> &bd) {
+        MicroBench::update_restore_interval(bd);
+        return 1;
+    }).print();
+
+    run<S>("  update/restore_movelist", positions, trials, false, [](Board<S> &bd) {
+        MicroBench::update_restore_movelist(bd);
+        return 1;
+    }).print();
+
+    run<S>("is_foul", positions, trials, true, [](Board<S> &bd) {
+        uint64_t n = 0;
+        for (auto m : MicroBench::move_list(bd)) {
+            bd.is_foul(m);
+            ++n;
+        }
+        return n;
+    }).print();
+
+    run<S>("see_of", positions, trials, true, [&](Board<S> &bd) {
+        uint64_t n = 0;
+        for (auto m : MicroBench::move_list(bd)) {
+            sink = sink + bd.see_of(m);
+            ++n;
+        }
+        return n;
+    }).print();
+
+    run<S>("MoveGen MAIN + next_move drain", positions, trials, true, [&](Board<S> &bd) {
+        MoveGen<S> mg(&bd);
+        while (mg.next_move().move != MOVE_NONE)
+            sink = sink + 1;
+        return 1;
+    }).print();
+}
+
+// Time TT probe and save with random keys at the given fill rate. Half of the
+// probed keys are saved before.
+void bench_tt(double fill, int trials) {
+    constexpr size_t        MbSize = 16, Ops = 1 << 20;
+    const size_t            cnt    = size_t(fill * MbSize * 1024 * 1024 / TranspositionTable::EntrySize);
+    PRNG                    rng(1070372);
+    std::vector<ZobristKey> keys(Ops);
+    OpStats                 probe{"TT probe, fill " + std::to_string(int(fill * 100)) + "%", {}, Ops};
+    OpStats                 save{"TT save, fill " + std::to_string(int(fill * 100)) + "%", {}, Ops};
+    volatile int            sink = 0;
+    bool                    found;
+
+    TT.resize(MbSize);
+    for (size_t i = 0; i != cnt; ++i)
+        TT.save(rng.rand<ZobristKey>(), MOVE_NONE, SCORE_ZERO, BOUND_EXACT, false, Depth(1 + i % 20));
+
+    for (size_t i = 0; i != Ops; ++i) {
+        keys[i] = rng.rand<ZobristKey>();
+        if (i & 1)
+            TT.save(keys[i], MOVE_NONE, SCORE_ZERO, BOUND_LOWER, false, Depth(1 + i % 20));
+    }
+
+    for (auto t = 0; t != trials; ++t) {
+        Clock::time_point start = Clock::now();
+        for (auto k : keys)
+            sink = sink + TT.probe(k, found).depth() + found;
+        probe.samples.push_back(ns_between(start, Clock::now()) / Ops);
+
+        start = Clock::now();
+        for (size_t i = 0; i != Ops; ++i)
+            TT.save(keys[i], MOVE_NONE, Score(i & 1023), BOUND_UPPER, false, Depth(1 + i % 20));
+        save.samples.push_back(ns_between(start, Clock::now()) / Ops);
+    }
+
+    probe.print();
+    save.print();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    const int rule   = argc > 1 ? std::atoi(argv[1]) : 0;
+    const int posCnt = argc > 2 ? std::atoi(argv[2]) : 200;
+    const int trials = argc > 3 ? std::atoi(argv[3]) : 10;
+    const int side   = argc > 4 && std::atoi(argv[4]) == 20 ? 20 : 15;
+
+    pattern_init(binary_directory(argv[0]));
+
+    if (!pattern_available(side)) {
+        std::cout << "pattern table of side " << side << " is missing" << std::endl;
+        return 1;
+    }
+
+    Threads.set(1);
+    Threads.set_rule(Rule(rule));
+    Threads.set_side(side);
+
+    const std::vector<Position> positions = side == 20 ? generate_positions<20>(posCnt) : generate_positions<15>(posCnt);
+
+    std::cout << "side " << side << ", rule " << int(Threads.rule) << ", " << positions.size() << " positions, " << trials << " trials\n"
+              << std::left << std::setw(32) << "operation" << std::right << std::setw(10) << "ns/op"
+              << std::setw(10) << "stddev" << std::setw(10) << "min" << std::setw(12) << "ops" << std::endl;
+
+    side == 20                ? bench_board<20, FREESTYLE>(positions, trials) :
+    Threads.rule == FREESTYLE ? bench_board<15, FREESTYLE>(positions, trials) :
+    Threads.rule == STANDARD  ? bench_board<15, STANDARD>(positions, trials) :
+                                bench_board<15, RENJU>(positions, trials);
+
+    for (double fill : {0.1, 0.5, 0.9})
+        bench_tt(fill, trials);
+
+    return 0;
+}
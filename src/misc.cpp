@@ -31,10 +31,24 @@ typedef bool (*fun1_t)(LOGICAL_PROCESSOR_RELATIONSHIP,
 typedef bool (*fun2_t)(USHORT, PGROUP_AFFINITY);
 typedef bool (*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#    include <pthread.h>
+#    include <sched.h>
 #endif
 
 #include "misc.h"
 
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <tuple>
 #include <vector>
 
 // Used to serialize access to std::cout to avoid multiple threads writing at
@@ -141,10 +155,13 @@ static void* aligned_large_pages_alloc_win(size_t allocSize) {
     return mem;
 }
 
-void* aligned_large_pages_alloc(size_t allocSize) {
+void* aligned_large_pages_alloc(size_t allocSize, PageBacking* backing) {
     // Try to allocate large pages
     void* mem = aligned_large_pages_alloc_win(allocSize);
 
+    if (backing)
+        *backing = mem ? PAGES_LARGE : PAGES_NORMAL;
+
     // Fall back to regular, page aligned, allocation if necessary
     if (!mem)
         mem = VirtualAlloc(NULL, allocSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
@@ -154,7 +171,41 @@ void* aligned_large_pages_alloc(size_t allocSize) {
 
 #else
 
-void* aligned_large_pages_alloc(size_t allocSize) {
+// Regions mapped on explicit huge pages with their sizes, which are needed to
+// unmap them in aligned_large_pages_free()
+static std::mutex              hugetlbMutex;
+static std::map<void*, size_t> hugetlbRegions;
+
+// thp_enabled() checks that transparent huge pages are not disabled, so that
+// madvise() could take effect
+static bool thp_enabled() {
+    std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string   mode;
+    return std::getline(file, mode) && mode.find("[never]") == std::string::npos;
+}
+
+void* aligned_large_pages_alloc(size_t allocSize, PageBacking* backing) {
+#    if defined(__linux__) && defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    // Try explicit huge pages first, which must be reserved by the administrator
+    // in /proc/sys/vm/nr_hugepages. 1GB pages are only tried for large sizes.
+    for (int shift : {30, 21}) {
+        const size_t pageSize = size_t(1) << shift;
+        if (shift == 30 && allocSize < pageSize)
+            continue;
+
+        size_t size = (allocSize + pageSize - 1) & ~(pageSize - 1);
+        void*  mem  = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+        if (mem != MAP_FAILED) {
+            std::lock_guard<std::mutex> lk(hugetlbMutex);
+            hugetlbRegions[mem] = size;
+            if (backing)
+                *backing = shift == 30 ? PAGES_HUGETLB_1G : PAGES_HUGETLB_2M;
+            return mem;
+        }
+    }
+#    endif
+
 #    if defined(__linux__)
     constexpr size_t alignment = 2 * 1024 * 1024; // assumed 2MB page size
 #    else
@@ -164,9 +215,13 @@ void* aligned_large_pages_alloc(size_t allocSize) {
     // round up to multiples of alignment
     size_t size = ((allocSize + alignment - 1) / alignment) * alignment;
     void*  mem  = std_aligned_alloc(alignment, size);
+    bool   thp  = false;
 #    if defined(MADV_HUGEPAGE)
-    madvise(mem, size, MADV_HUGEPAGE);
+    // Then transparent huge pages, which the kernel may give or not
+    thp = mem && !madvise(mem, size, MADV_HUGEPAGE) && thp_enabled();
 #    endif
+    if (backing)
+        *backing = thp ? PAGES_TRANSPARENT : PAGES_NORMAL;
     return mem;
 }
 
@@ -186,12 +241,180 @@ void aligned_large_pages_free(void* mem) {
 #else
 
 void aligned_large_pages_free(void* mem) {
+    if (!mem)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lk(hugetlbMutex);
+        auto                        it = hugetlbRegions.find(mem);
+        if (it != hugetlbRegions.end()) {
+            munmap(mem, it->second);
+            hugetlbRegions.erase(it);
+            return;
+        }
+    }
+
     std_aligned_free(mem);
 }
 
 #endif
 
-#ifndef _WIN32
+// page_backing_name() returns the description of the pages for messages
+const char* page_backing_name(PageBacking backing) {
+    constexpr const char* Names[] = {"normal pages", "transparent huge pages", "2MB huge pages", "1GB huge pages", "large pages"};
+    return Names[backing];
+}
+
+// map_file() maps size bytes of the file from offset into memory. The mapping is
+// copy-on-write, so the memory can be modified without touching the file. Pages
+// are read in lazily on first access. The offset should be a multiple of the page
+// size and the file should be at least offset + size bytes long.
+#if defined(_WIN32)
+
+void* map_file(const std::string& path, size_t offset, size_t size) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return nullptr;
+
+    void* mem = MapViewOfFile(mapping, FILE_MAP_COPY, DWORD(uint64_t(offset) >> 32), DWORD(offset), size);
+    CloseHandle(mapping); // The view keeps the mapping alive
+    return mem;
+}
+
+void unmap_file(void* mem, size_t) {
+    if (mem)
+        UnmapViewOfFile(mem);
+}
+
+#else
+
+void* map_file(const std::string& path, size_t offset, size_t size) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, off_t(offset));
+    close(fd); // The mapping keeps the file alive
+    return mem == MAP_FAILED ? nullptr : mem;
+}
+
+void unmap_file(void* mem, size_t size) {
+    if (mem)
+        munmap(mem, size);
+}
+
+#endif
+
+// binary_directory() returns the directory of the executable from argv[0], so
+// that the data files next to the executable are found from any working
+// directory. The working directory is used if argv[0] has no directory part.
+std::string binary_directory(const std::string& argv0) {
+    const size_t pos = argv0.find_last_of("/\\");
+    return pos == std::string::npos ? "" : argv0.substr(0, pos + 1);
+}
+
+#if defined(__linux__)
+
+// read_cpu_list() parses a cpu list of sysfs like "0-3,8-11". An empty list is
+// returned if the file does not exist.
+static std::vector<int> read_cpu_list(const std::string& path) {
+    std::ifstream    file(path);
+    std::string      range;
+    std::vector<int> cpus;
+    int              first, last;
+    char             dash;
+
+    while (std::getline(file, range, ',')) {
+        std::istringstream is(range);
+        if (!(is >> first))
+            continue;
+        last = (is >> dash >> last) ? last : first;
+        for (int c = first; c <= last; ++c)
+            cpus.push_back(c);
+    }
+
+    return cpus;
+}
+
+static int read_int(const std::string& path, int defaultValue) {
+    std::ifstream file(path);
+    int           value;
+    return (file >> value) ? value : defaultValue;
+}
+
+// cpu_order() discovers the topology from sysfs and returns the online logical
+// processors in the order to bind threads to. Threads fill one logical processor
+// of every physical core of a node before moving on to the next node. Then the
+// SMT siblings are spread evenly across the nodes. The topology is read once.
+static const std::vector<int>& cpu_order() {
+    static const std::vector<int> order = [] {
+        const std::string cpuDir  = "/sys/devices/system/cpu/";
+        const std::string nodeDir = "/sys/devices/system/node/";
+
+        std::vector<int>    cpus = read_cpu_list(cpuDir + "online");
+        std::map<int, int>  nodeOf;
+        std::vector<int>    nodes = read_cpu_list(nodeDir + "online");
+        std::vector<int>    result;
+
+        for (int n : nodes)
+            for (int c : read_cpu_list(nodeDir + "node" + std::to_string(n) + "/cpulist"))
+                nodeOf[c] = n;
+
+        // Logical processors of each core, keyed by (node, package, core)
+        std::map<std::tuple<int, int, int>, std::vector<int>> cores;
+
+        for (int c : cpus) {
+            const std::string topo = cpuDir + "cpu" + std::to_string(c) + "/topology/";
+            cores[{nodeOf.count(c) ? nodeOf[c] : 0,
+                   read_int(topo + "physical_package_id", 0),
+                   read_int(topo + "core_id", c)}]
+                .push_back(c);
+        }
+
+        // First logical processor of each core, node by node
+        std::map<int, std::vector<int>> siblings;
+        size_t                          maxSiblings = 0;
+
+        for (auto& [key, logical] : cores) {
+            result.push_back(logical[0]);
+            auto& s = siblings[std::get<0>(key)];
+            s.insert(s.end(), logical.begin() + 1, logical.end());
+            maxSiblings = std::max(maxSiblings, s.size());
+        }
+
+        // Then SMT siblings in turn across the nodes
+        for (size_t i = 0; i < maxSiblings; ++i)
+            for (auto& [node, s] : siblings)
+                if (i < s.size())
+                    result.push_back(s[i]);
+
+        return result;
+    }();
+
+    return order;
+}
+
+// bindThisThread() sets the affinity of the current thread to the logical
+// processor for the thread with index idx. If there are more threads than
+// logical processors, let the OS decide.
+void bindThisThread(size_t idx) {
+    const std::vector<int>& order = cpu_order();
+
+    if (idx >= order.size())
+        return;
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(order[idx], &mask);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask);
+}
+
+#elif !defined(_WIN32)
 
 void bindThisThread(size_t) {
 }
@@ -14,6 +14,7 @@
 #include <chrono>
 #include <iostream>
 #include <mutex>
+#include <string>
 
 enum SyncCout { IO_LOCK,
                 IO_UNLOCK };
@@ -106,9 +107,37 @@ inline uint64_t mul_hi64(uint64_t a, uint64_t b) {
 #endif
 }
 
+// lsb() returns the index of the least significant bit of a non-zero integer
+inline int lsb(uint32_t b) {
+    assert(b);
+#if defined(__GNUC__)
+    return __builtin_ctz(b);
+#else
+    int idx = 0;
+    while (!(b & 1)) {
+        b >>= 1;
+        ++idx;
+    }
+    return idx;
+#endif
+}
+
+// Kinds of pages backing the memory of aligned_large_pages_alloc()
+enum PageBacking {
+    PAGES_NORMAL,
+    PAGES_TRANSPARENT,
+    PAGES_HUGETLB_2M,
+    PAGES_HUGETLB_1G,
+    PAGES_LARGE // Windows large pages
+};
+
 void  prefetch(void* addr);
 void* std_aligned_alloc(size_t alignment, size_t size);
 void  std_aligned_free(void* ptr);
-void* aligned_large_pages_alloc(size_t size); // memory aligned by page size, min alignment: 4096 bytes
-void  aligned_large_pages_free(void* mem);    // nop if mem == nullptr
+void* aligned_large_pages_alloc(size_t size, PageBacking* backing = nullptr); // memory aligned by page size, min alignment: 4096 bytes
+void  aligned_large_pages_free(void* mem);                                   // nop if mem == nullptr
+const char* page_backing_name(PageBacking backing);
+void* map_file(const std::string& path, size_t offset, size_t size); // private writable view of the file, nullptr if not possible
+void  unmap_file(void* mem, size_t size);                           // nop if mem == nullptr
+std::string binary_directory(const std::string& argv0);             // with the trailing separator, "" if unknown
 void  bindThisThread(size_t idx);
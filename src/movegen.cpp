@@ -10,7 +10,9 @@
 
 #include "movegen.h"
 
-MoveGen::MoveGen(Board *bd, Stage stg, Move ttm, bool rnode, Depth p, Move *karr, Move cm) {
+template <int S>
+MoveGen<S>::MoveGen(Board<S> *bd, Stage stg, Move ttm, bool rnode, Depth p, Move *karr, Move cm)
+    : movelist(bd->moveStack) {
     // Late movelist update
     if (!bd->updatedMoveList[bd->pieceCnt]) {
         bd->update_movelist(bd->last_move(1));
@@ -19,7 +21,7 @@ MoveGen::MoveGen(Board *bd, Stage stg, Move ttm, bool rnode, Depth p, Move *karr
 
     picked   = 0;
     pbd      = bd;
-    ttMove   = ttm != MOVE_NONE && pbd->mListStack[pbd->pieceCnt].contains(ttm) ? ttm : MOVE_NONE;
+    ttMove   = ttm != MOVE_NONE && pbd->mList.contains(ttm) ? ttm : MOVE_NONE;
     stage    = stg + int(ttMove == MOVE_NONE);
     rootNode = rnode;
     ply      = p;
@@ -27,12 +29,14 @@ MoveGen::MoveGen(Board *bd, Stage stg, Move ttm, bool rnode, Depth p, Move *karr
     if (karr != nullptr) {
         killers[0] = karr[0];
         killers[1] = karr[1];
-    }
+    } else
+        killers[0] = killers[1] = MOVE_NONE;
     counterMove = cm;
 }
 
 // MoveGen::score_of() returns the heuristic score for move picking
-Score MoveGen::score_of(Move m) {
+template <int S>
+Score MoveGen<S>::score_of(Move m) {
     Score score = pbd->see_of(m);
     int   dist[4];
 
@@ -54,8 +58,8 @@ Score MoveGen::score_of(Move m) {
 // MoveGen::Generate<WLD> generates one move to win or lose with its actual score.
 // It should only be called when pbd->check_wld(offset) does not return PIECE_NONE
 // and offset is greater than 0. This function is not time critical.
-template <>
-ExtMove MoveGen::generate<WLD>() {
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<WLD>) {
     int offset;
 
     assert(pbd->check_wld(offset) != PIECE_NONE);
@@ -65,15 +69,15 @@ ExtMove MoveGen::generate<WLD>() {
 
     // If we have F4 or B4, we form C5 to win
     if (pbd->query(pbd->sideToMove, F4) > 0 || pbd->query(pbd->sideToMove, B4) > 0)
-        for (auto &m : pbd->mListStack[pbd->pieceCnt])
-            if (pbd->query<US, INC>(pbd->sideToMove, m, C5) > 0) {
+        for (auto &m : pbd->mList)
+            if (pbd->template query<US, INC>(pbd->sideToMove, m, C5) > 0) {
                 movelist.insert(m, SCORE_WIN - offset);
                 return *begin();
             }
 
     // If opponent has F4, we defend and lose. Cannot call pbd->query in this case
     if (pbd->query(pbd->oppoToMove, F4) > 0)
-        for (auto &m : pbd->mListStack[pbd->pieceCnt]) {
+        for (auto &m : pbd->mList) {
             pbd->do_move(m);
             if (pbd->query_inc(pbd->sideToMove, F4) < 0) {
                 pbd->undo_move();
@@ -91,7 +95,7 @@ ExtMove MoveGen::generate<WLD>() {
 
     // If we have F3 and neither has B4, we form F4 to win
     if (pbd->query(pbd->sideToMove, F3) > 0 && pbd->query(pbd->oppoToMove, B4) == 0)
-        for (auto &i : pbd->F3Stack[pbd->pieceCnt])
+        for (auto &i : pbd->F3_packs())
             if (i.piece == pbd->sideToMove) {
                 movelist.insert(i.F4a[0], SCORE_WIN - offset);
                 return *begin();
@@ -104,9 +108,9 @@ ExtMove MoveGen::generate<WLD>() {
 }
 
 // MoveGen::generate<DEFEND_B4> generates one move to defend opponent's B4
-template <>
-ExtMove MoveGen::generate<DEFEND_B4>() {
-    assert(is_ok(pbd->defend_B4()));
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<DEFEND_B4>) {
+    assert(is_ok(pbd->defend_B4(), S));
 
     movelist.insert(pbd->defend_B4());
 
@@ -117,17 +121,17 @@ ExtMove MoveGen::generate<DEFEND_B4>() {
 
 // MoveGen::generate<DEFEND_F3> generates moves to defend opponent's F3 or form
 // side to move's B4.
-template <>
-ExtMove MoveGen::generate<DEFEND_F3>() {
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<DEFEND_F3>) {
     // Generate defending F3 moves from F3 pack. Calling the query function may
     // give wrong result. Add bonus so that these moves can be picked first.
-    for (auto &i : pbd->F3Stack[pbd->pieceCnt])
+    for (auto &i : pbd->F3_packs())
         for (auto &m : i.F3d)
             if (m != MOVE_NONE)
                 movelist.insert(m, score_of(m) + BONUS_F3D);
 
-    for (auto &m : pbd->mListStack[pbd->pieceCnt])
-        if (pbd->query<US, INC>(pbd->sideToMove, m, B4) > 0)
+    for (auto &m : pbd->mList)
+        if (pbd->template query<US, INC>(pbd->sideToMove, m, B4) > 0)
             movelist.insert(m, score_of(m));
 
     assert(size() > 0);
@@ -136,9 +140,9 @@ ExtMove MoveGen::generate<DEFEND_F3>() {
 }
 
 // MoveGen::generate<ALL> generates all possible moves
-template <>
-ExtMove MoveGen::generate<DEFAULT>() {
-    for (auto &m : pbd->mListStack[pbd->pieceCnt])
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<DEFAULT>) {
+    for (auto &m : pbd->mList)
         movelist.insert(m, score_of(m));
 
     assert(size() > 0);
@@ -147,8 +151,8 @@ ExtMove MoveGen::generate<DEFAULT>() {
 }
 
 // MoveGen::generate<LARGE> generates all possible moves with a larger neighbor
-template <>
-ExtMove MoveGen::generate<LARGE>() {
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<LARGE>) {
     Move m;
 
     for (auto i = 0; i != pbd->pieceCnt; ++i) {
@@ -166,28 +170,71 @@ ExtMove MoveGen::generate<LARGE>() {
 // MoveGen::generate<MAIN> generates all possible moves using different ways
 // automatically, with their heuristic score. Call this function when wld is
 // uncertain.
-template <>
-ExtMove MoveGen::generate<MAIN>() {
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<MAIN>) {
     if (pbd->query(pbd->oppoToMove, B4) > 0)
-        generate<DEFEND_B4>();
+        generate(Gen<DEFEND_B4>());
 
     else if (pbd->query(pbd->oppoToMove, F3) > 0)
-        generate<DEFEND_F3>();
+        generate(Gen<DEFEND_F3>());
 
     else if (ply < 2 && pbd->pieceCnt < 5)
-        generate<LARGE>();
+        generate(Gen<LARGE>());
 
     else
-        generate<DEFAULT>();
+        generate(Gen<DEFAULT>());
 
     assert(size() > 0);
 
     return *begin();
 }
 
+// MoveGen::generate<THREAT> generates the moves forming side to move's B4 or F3,
+// the first stage of main search when neither side has a threat. The moves of
+// the later stages are not scored if one of these moves cuts off.
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<THREAT>) {
+    constexpr uint32_t Mask = (1u << B4) | (1u << F3);
+
+    for (auto &m : pbd->mList)
+        for (auto d = Direction(0); d != DIRECTION_NUM; ++d)
+            if (pbd->query_see(pbd->sideToMove, pbd->index_of(m, d), pbd->index_on(m, d), Mask)) {
+                movelist.insert(m, score_of(m));
+                break;
+            }
+
+    return *begin();
+}
+
+// MoveGen::generate<REFUTATION> generates the killer moves and the counter move
+// not generated yet
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<REFUTATION>) {
+    for (auto m : {killers[0], killers[1], counterMove})
+        if (m != MOVE_NONE && pbd->mList.contains(m))
+            movelist.insert(m, score_of(m));
+
+    return *begin();
+}
+
+// MoveGen::generate<QUIET> generates the rest of the moves, the last stage of
+// main search when neither side has a threat. The moves are sorted once here,
+// so that picking them is of constant time instead of a scan of the rest.
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<QUIET>) {
+    const iterator first = end();
+
+    for (auto &m : pbd->mList)
+        movelist.insert(m, score_of(m));
+
+    std::sort(first, end(), [](const ExtMove &lhs, const ExtMove &rhs) { return rhs < lhs; });
+
+    return *begin();
+}
+
 // MoveGen::generate<TT_MOVE> adds one legal tt move to the movelist
-template <>
-ExtMove MoveGen::generate<TT_MOVE>() {
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<TT_MOVE>) {
     movelist.insert(ttMove);
 
     assert(size() > 0);
@@ -196,46 +243,99 @@ ExtMove MoveGen::generate<TT_MOVE>() {
 }
 
 // MoveGen::generate<VCF_ROOT> generates moves for VCF search root node
-template <>
-ExtMove MoveGen::generate<VCF_ROOT>() {
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<VCF_ROOT>) {
     if (pbd->query(pbd->oppoToMove, B4) > 0) {
         // If opponent has B4, we defend and form F4 or B4
-        if (pbd->query<US, INC>(pbd->sideToMove, pbd->defend_B4(), F4) > 0 || pbd->query<US, INC>(pbd->sideToMove, pbd->defend_B4(), B4) > 0)
+        if (pbd->template query<US, INC>(pbd->sideToMove, pbd->defend_B4(), F4) > 0 || pbd->template query<US, INC>(pbd->sideToMove, pbd->defend_B4(), B4) > 0)
             movelist.insert(pbd->defend_B4());
     } else {
         // We form B4
-        for (auto &m : pbd->mListStack[pbd->pieceCnt])
-            if (pbd->query<US, INC>(pbd->sideToMove, m, B4) > 0 && (pbd->query<US, INC>(pbd->sideToMove, m, B4) >= 2 || pbd->query<US, INC>(pbd->sideToMove, m, F3) > 0 || pbd->query<US, INC>(pbd->sideToMove, m, B3) > 0 || pbd->query_vcf(pbd->sideToMove, m) > 0))
+        for (auto &m : pbd->mList)
+            if (pbd->template query<US, INC>(pbd->sideToMove, m, B4) > 0 && (pbd->template query<US, INC>(pbd->sideToMove, m, B4) >= 2 || pbd->template query<US, INC>(pbd->sideToMove, m, F3) > 0 || pbd->template query<US, INC>(pbd->sideToMove, m, B3) > 0 || pbd->query_vcf(pbd->sideToMove, m) > 0))
                 movelist.insert(m, pbd->see_of(m));
     }
     return *begin();
 }
 
 // MoveGen::generate<VCF_ROOT> generates moves for VCF search child node
-template <>
-ExtMove MoveGen::generate<VCF_CHILD>() {
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<VCF_CHILD>) {
     Move m;
 
     if (pbd->query(pbd->oppoToMove, B4) > 0) {
         // If opponent has B4, we defend and form F4 or B4
-        if (pbd->query<US, INC>(pbd->sideToMove, pbd->defend_B4(), F4) > 0 || pbd->query<US, INC>(pbd->sideToMove, pbd->defend_B4(), B4) > 0)
+        if (pbd->template query<US, INC>(pbd->sideToMove, pbd->defend_B4(), F4) > 0 || pbd->template query<US, INC>(pbd->sideToMove, pbd->defend_B4(), B4) > 0)
             movelist.insert(pbd->defend_B4());
     } else {
         // We form B4 in neighborhood
         for (auto &i : N4) {
             m = pbd->last_move(2) + i;
 
-            if (pbd->is_empty(m) && pbd->query<US, INC>(pbd->sideToMove, m, B4) > 0 && (pbd->query<US, INC>(pbd->sideToMove, m, B4) >= 2 || pbd->query<US, INC>(pbd->sideToMove, m, F3) > 0 || pbd->query<US, INC>(pbd->sideToMove, m, B3) > 0 || pbd->query_vcf(pbd->sideToMove, m) > 0))
+            if (pbd->is_empty(m) && pbd->template query<US, INC>(pbd->sideToMove, m, B4) > 0 && (pbd->template query<US, INC>(pbd->sideToMove, m, B4) >= 2 || pbd->template query<US, INC>(pbd->sideToMove, m, F3) > 0 || pbd->template query<US, INC>(pbd->sideToMove, m, B3) > 0 || pbd->query_vcf(pbd->sideToMove, m) > 0))
+                movelist.insert(m, pbd->see_of(m));
+        }
+    }
+    return *begin();
+}
+
+// MoveGen::generate<VCT_ROOT> generates moves for VCT search root node
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<VCT_ROOT>) {
+    if (pbd->query(pbd->oppoToMove, B4) > 0)
+        // If opponent has B4, we defend and keep the threat if any remains
+        movelist.insert(pbd->defend_B4());
+    else {
+        // We form B4, or also F3 if opponent has no F3
+        bool b4Only = pbd->query(pbd->oppoToMove, F3) > 0;
+
+        for (auto &m : pbd->mList)
+            if (pbd->template query<US, INC>(pbd->sideToMove, m, B4) > 0 || (!b4Only && pbd->template query<US, INC>(pbd->sideToMove, m, F3) > 0))
+                movelist.insert(m, pbd->see_of(m));
+    }
+    return *begin();
+}
+
+// MoveGen::generate<VCT_CHILD> generates moves for VCT search child node
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<VCT_CHILD>) {
+    Move m;
+
+    if (pbd->query(pbd->oppoToMove, B4) > 0)
+        // If opponent has B4, we defend and keep the threat if any remains
+        movelist.insert(pbd->defend_B4());
+    else {
+        // We form B4, or also F3 if opponent has no F3, in neighborhood
+        bool b4Only = pbd->query(pbd->oppoToMove, F3) > 0;
+
+        for (auto &i : N4) {
+            m = pbd->last_move(2) + i;
+
+            if (pbd->is_empty(m) && (pbd->template query<US, INC>(pbd->sideToMove, m, B4) > 0 || (!b4Only && pbd->template query<US, INC>(pbd->sideToMove, m, F3) > 0)))
                 movelist.insert(m, pbd->see_of(m));
         }
     }
     return *begin();
 }
 
+// MoveGen::generate<VCT_DEFEND> generates all moves to defend opponent's B4 or
+// F3 in VCT search. Nothing is generated if opponent has no threat.
+template <int S>
+ExtMove MoveGen<S>::generate(Gen<VCT_DEFEND>) {
+    if (pbd->query(pbd->oppoToMove, B4) > 0)
+        generate(Gen<DEFEND_B4>());
+
+    else if (pbd->query(pbd->oppoToMove, F3) > 0)
+        generate(Gen<DEFEND_F3>());
+
+    return *begin();
+}
+
 // MoveGen::next_move() is the most important function of the MoveGen class. It
 // returns a new move every time it is called until there are no more moves left,
 // picking the move with the highest score from a list of generated moves.
-ExtMove MoveGen::next_move() {
+template <int S>
+ExtMove MoveGen<S>::next_move() {
     iterator bestIt;
     ExtMove  bestEm;
 
@@ -243,27 +343,69 @@ top:
     switch (stage) {
     case MAIN_TT:
     case VCF_TT:
+    case VCT_TT:
+    case VCT_DEFEND_TT:
         generate<TT_MOVE>();
         ++picked;
         ++stage;
 
         assert(is_ok(begin()->move));
-        assert(pbd->mListStack[pbd->pieceCnt].contains(begin()->move));
+        assert(pbd->mList.contains(begin()->move));
 
         return *begin();
 
+    // Moves are generated in stages only when neither side has a threat, where
+    // the move picked first often cuts off. Otherwise all are generated at once.
     case MAIN_INIT:
-        generate<MAIN>();
+        if (pbd->query(pbd->oppoToMove, B4) > 0 || pbd->query(pbd->oppoToMove, F3) > 0 || (ply < 2 && pbd->pieceCnt < 5)) {
+            generate<MAIN>();
+            stage = MAIN_PICK;
+        } else {
+            generate<THREAT>();
+            ++stage;
+        }
+        goto top;
+
+    case MAIN_REFUTATION_INIT:
+        generate<REFUTATION>();
         ++stage;
         goto top;
 
+    case MAIN_QUIET_INIT:
+        generate<QUIET>();
+        ++stage;
+        goto top;
+
+    // Quiet moves are already sorted, so they are picked in order
+    case MAIN_QUIET_PICK:
+        if (current() == end()) {
+            stage = MAIN_END;
+            goto top;
+        }
+
+        return *(begin() + picked++);
+
     case VCF_INIT:
         rootNode ? generate<VCF_ROOT>() : generate<VCF_CHILD>();
         ++stage;
         goto top;
 
+    case VCT_INIT:
+        rootNode ? generate<VCT_ROOT>() : generate<VCT_CHILD>();
+        ++stage;
+        goto top;
+
+    case VCT_DEFEND_INIT:
+        generate<VCT_DEFEND>();
+        ++stage;
+        goto top;
+
+    case MAIN_THREAT_PICK:
+    case MAIN_REFUTATION_PICK:
     case MAIN_PICK:
     case VCF_PICK:
+    case VCT_PICK:
+    case VCT_DEFEND_PICK:
         // No available moves
         if (current() == end()) {
             ++stage;
@@ -286,6 +428,8 @@ top:
 
     case MAIN_END:
     case VCF_END:
+    case VCT_END:
+    case VCT_DEFEND_END:
         return {MOVE_NONE, SCORE_NONE};
     }
 
@@ -295,7 +439,15 @@ top:
     return {MOVE_NONE, SCORE_NONE};
 }
 
-std::ostream &operator<<(std::ostream &os, const MoveGen &mg) {
+template <int S>
+std::ostream &operator<<(std::ostream &os, const MoveGen<S> &mg) {
     std::cout << mg.movelist;
     return os;
 }
+
+// Instantiations of the move generator of each side
+template class MoveGen<15>;
+template class MoveGen<20>;
+
+template std::ostream &operator<<(std::ostream &os, const MoveGen<15> &mg);
+template std::ostream &operator<<(std::ostream &os, const MoveGen<20> &mg);
@@ -19,35 +19,61 @@ enum GenType {
     DEFAULT,
     LARGE,
     MAIN,
+    THREAT,
+    REFUTATION,
+    QUIET,
     TT_MOVE,
     VCF_ROOT,
-    VCF_CHILD
+    VCF_CHILD,
+    VCT_ROOT,
+    VCT_CHILD,
+    VCT_DEFEND
 };
 
 enum Stage {
     MAIN_TT,
     MAIN_INIT,
+    MAIN_THREAT_PICK,
+    MAIN_REFUTATION_INIT,
+    MAIN_REFUTATION_PICK,
+    MAIN_QUIET_INIT,
+    MAIN_QUIET_PICK,
     MAIN_PICK,
     MAIN_END,
     VCF_TT,
     VCF_INIT,
     VCF_PICK,
     VCF_END,
+    VCT_TT,
+    VCT_INIT,
+    VCT_PICK,
+    VCT_END,
+    VCT_DEFEND_TT,
+    VCT_DEFEND_INIT,
+    VCT_DEFEND_PICK,
+    VCT_DEFEND_END,
 };
 
 ENABLE_ADDITION_OPERATORS_ON(Stage)
 
+// Gen is the tag type of a generation type, so that each type has an overload
+// of MoveGen::generate()
+template <GenType T>
+using Gen = std::integral_constant<GenType, T>;
+
 // MoveGen class is used to generate moves as the requested type and pick one
-// move at a time from the current position.
+// move at a time from the current position on the board of side S.
+template <int S>
 class MoveGen {
-    friend std::ostream &operator<<(std::ostream &os, const MoveGen &mg);
+    template <int Side>
+    friend std::ostream &operator<<(std::ostream &os, const MoveGen<Side> &mg);
 
 public:
-    typedef MoveList<ExtMove>::iterator             iterator;
-    typedef const MoveList<ExtMove>::const_iterator const_iterator;
-    typedef MoveList<ExtMove>::size_type            size_type;
+    typedef typename ExtMoveList<S>::iterator             iterator;
+    typedef const typename ExtMoveList<S>::const_iterator const_iterator;
+    typedef typename ExtMoveList<S>::size_type            size_type;
 
-    MoveGen(Board *bd,
+    MoveGen(Board<S> *bd,
             Stage  stg   = MAIN_TT,
             Move   ttm   = MOVE_NONE,
             bool   rnode = false,
@@ -71,23 +97,46 @@ public:
         return movelist.size();
     }
 
+    // Moves already in the list are marked while generating, so that they are
+    // not inserted twice
     template <GenType T>
-    ExtMove generate();
+    ExtMove generate() {
+        movelist.mark();
+        ExtMove em = generate(Gen<T>());
+        movelist.unmark();
+        return em;
+    }
     ExtMove next_move();
 
 private:
-    MoveList<ExtMove> movelist;
-    int               picked;
-
-    Board *pbd;
-    Stage  stage;
-    Move   ttMove;
-    bool   rootNode;
-    Depth  ply;
-    Move   killers[2];
-    Move   counterMove;
-
-    Score score_of(Move m);
+    ExtMoveList<S> movelist;
+    int            picked;
+
+    Board<S> *pbd;
+    Stage     stage;
+    Move      ttMove;
+    bool      rootNode;
+    Depth     ply;
+    Move      killers[2];
+    Move      counterMove;
+
+    Score   score_of(Move m);
+    ExtMove generate(Gen<WLD>);
+    ExtMove generate(Gen<DEFEND_B4>);
+    ExtMove generate(Gen<DEFEND_F3>);
+    ExtMove generate(Gen<DEFAULT>);
+    ExtMove generate(Gen<LARGE>);
+    ExtMove generate(Gen<MAIN>);
+    ExtMove generate(Gen<THREAT>);
+    ExtMove generate(Gen<REFUTATION>);
+    ExtMove generate(Gen<QUIET>);
+    ExtMove generate(Gen<TT_MOVE>);
+    ExtMove generate(Gen<VCF_ROOT>);
+    ExtMove generate(Gen<VCF_CHILD>);
+    ExtMove generate(Gen<VCT_ROOT>);
+    ExtMove generate(Gen<VCT_CHILD>);
+    ExtMove generate(Gen<VCT_DEFEND>);
 };
 
-std::ostream &operator<<(std::ostream &os, const MoveGen &mg);
+template <int S>
+std::ostream &operator<<(std::ostream &os, const MoveGen<S> &mg);
@@ -56,8 +56,9 @@ private:
     uint64_t bitboard[BITBOARD_SIZE];
 };
 
-// MoveList class is a templated class storing Moves or ExtMoves.
-template <typename T>
+// MoveList class is a templated class storing Moves or ExtMoves. The capacity is
+// the number of squares of the board of side S.
+template <typename T, int S>
 class MoveList {
     static_assert(std::is_same<T, Move>::value || std::is_same<T, ExtMove>::value, "T should be Move or ExtMove");
 
@@ -69,8 +70,8 @@ public:
     MoveList() {
         reset();
     }
-    MoveList(const MoveList<T> &ml);
-    MoveList<T> &operator=(const MoveList<T> &ml);
+    MoveList(const MoveList &ml);
+    MoveList &operator=(const MoveList &ml);
 
     iterator begin() {
         return movelist;
@@ -90,88 +91,110 @@ public:
 
     void reset();
     bool contains(Move m) const;
+    int  index_of(Move m) const;
     void insert(Move m, Score s = SCORE_NONE);
     void remove(Move m);
+    void restore(Move m, int ind);
+    void pop_back();
     void swap(iterator it1, iterator it2);
 
 private:
-    T        movelist[MOVE_SIZE + 1], *offTheEnd;
+    T        movelist[S * S + 1], *offTheEnd;
     BitBoard bitboard;
 };
 
-template <typename T>
-inline MoveList<T>::MoveList(const MoveList<T> &ml) {
-    memcpy(movelist, ml.movelist, sizeof(movelist));
+// Only the moves in use are copied. The rest of the array is never read.
+template <typename T, int S>
+inline MoveList<T, S>::MoveList(const MoveList &ml) {
+    memcpy(movelist, ml.movelist, ml.size() * sizeof(T));
     offTheEnd = movelist + ml.size();
     bitboard  = ml.bitboard;
 }
 
-template <typename T>
-inline MoveList<T> &MoveList<T>::operator=(const MoveList<T> &ml) {
-    memcpy(movelist, ml.movelist, sizeof(movelist));
+template <typename T, int S>
+inline MoveList<T, S> &MoveList<T, S>::operator=(const MoveList &ml) {
+    memcpy(movelist, ml.movelist, ml.size() * sizeof(T));
     offTheEnd = movelist + ml.size();
     bitboard  = ml.bitboard;
     return *this;
 }
 
-template <typename T>
-inline void MoveList<T>::reset() {
+template <typename T, int S>
+inline void MoveList<T, S>::reset() {
     offTheEnd = movelist;
     bitboard.reset();
 }
 
-template <typename T>
-inline bool MoveList<T>::contains(Move m) const {
-    assert(is_ok(m));
+template <typename T, int S>
+inline bool MoveList<T, S>::contains(Move m) const {
+    assert(is_ok(m, S));
 
     return bitboard.contains(m);
 }
 
-template <>
-inline void MoveList<Move>::insert(Move m, Score s) {
-    assert(is_ok(m));
-    (void)s; // Silence warning
+// Return the index of the move in the list, or -1 if it is not in the list. Only
+// for the list of Moves.
+template <typename T, int S>
+inline int MoveList<T, S>::index_of(Move m) const {
+    assert(is_ok(m, S));
 
-    if (!contains(m)) {
-        *offTheEnd++ = m;
-        bitboard.insert(m);
-    }
+    return contains(m) ? std::find(begin(), end(), m) - begin() : -1;
 }
 
-template <>
-inline void MoveList<ExtMove>::insert(Move m, Score s) {
-    assert(is_ok(m));
+template <typename T, int S>
+inline void MoveList<T, S>::insert(Move m, Score s) {
+    assert(is_ok(m, S));
 
     if (!contains(m)) {
-        *offTheEnd++ = {m, s};
+        if constexpr (std::is_same<T, Move>::value) {
+            (void)s; // Silence warning
+            *offTheEnd++ = m;
+        } else
+            *offTheEnd++ = {m, s};
         bitboard.insert(m);
     }
 }
 
-template <>
-inline void MoveList<Move>::remove(Move m) {
-    assert(is_ok(m));
+template <typename T, int S>
+inline void MoveList<T, S>::remove(Move m) {
+    assert(is_ok(m, S));
 
     if (contains(m)) {
-        Move *pos = std::find_if(begin(), end(), [&](const Move &e) { return e == m; });
-        *pos      = *--offTheEnd;
+        T *pos = std::find_if(begin(), end(), [&](const T &e) {
+            if constexpr (std::is_same<T, Move>::value)
+                return e == m;
+            else
+                return e.move == m;
+        });
+        *pos = *--offTheEnd;
         bitboard.remove(m);
     }
 }
 
-template <>
-inline void MoveList<ExtMove>::remove(Move m) {
-    assert(is_ok(m));
+// Put back a move removed from index ind. This is the exact inverse of remove(),
+// so the order of the list is restored as well. Only for the list of Moves.
+template <typename T, int S>
+inline void MoveList<T, S>::restore(Move m, int ind) {
+    assert(is_ok(m, S));
+    assert(!contains(m));
+    assert(0 <= ind && ind <= int(size()));
 
-    if (contains(m)) {
-        ExtMove *pos = std::find_if(begin(), end(), [&](const ExtMove &e) { return e.move == m; });
-        *pos         = *--offTheEnd;
-        bitboard.remove(m);
-    }
+    *offTheEnd++  = movelist[ind];
+    movelist[ind] = m;
+    bitboard.insert(m);
 }
 
-template <typename T>
-inline void MoveList<T>::swap(iterator it1, iterator it2) {
+// Remove the last move. This is the exact inverse of insert(). Only for the list
+// of Moves.
+template <typename T, int S>
+inline void MoveList<T, S>::pop_back() {
+    assert(size() > 0);
+
+    bitboard.remove(*--offTheEnd);
+}
+
+template <typename T, int S>
+inline void MoveList<T, S>::swap(iterator it1, iterator it2) {
     assert(begin() <= it1 && it1 < end());
     assert(begin() <= it2 && it2 < end());
 
@@ -180,8 +203,125 @@ inline void MoveList<T>::swap(iterator it1, iterator it2) {
     *it2  = tmp;
 }
 
-template <typename T>
-inline std::ostream &operator<<(std::ostream &os, const MoveList<T> &ml) {
+template <typename T, int S>
+inline std::ostream &operator<<(std::ostream &os, const MoveList<T, S> &ml) {
+    for (auto &i : ml)
+        std::cout << i << " ";
+    return os;
+}
+
+// MoveStack struct stores the ExtMove lists of all move generators of a board.
+// The generators are nested like the search frames holding them, so each list
+// is a range of the stack and only the list on the top grows. A list holds each
+// move at most once, and search holds at most one generator per ply below
+// DEPTH_MAX plus the one of the root, so the stack can never overflow. Marks are
+// set only for the moves of the list being generated, so that duplicates are
+// found in constant time without zeroing.
+template <int S>
+struct MoveStack {
+    static constexpr int Capacity = int(DEPTH_NUM) * (S * S + 1);
+
+    ExtMove  moves[Capacity];
+    ExtMove *top = moves;
+    BitBoard marks;
+};
+
+// ExtMoveList class is a list of ExtMoves on the top of a move stack. The range
+// is taken from the stack on construction and given back on destruction.
+template <int S>
+class ExtMoveList {
+public:
+    typedef ExtMove *       iterator;
+    typedef const ExtMove * const_iterator;
+    typedef std::size_t     size_type;
+
+    explicit ExtMoveList(MoveStack<S> &ms) : stack(ms), first(ms.top), last(ms.top) {}
+    ~ExtMoveList() {
+        assert(stack.top == last);
+
+        stack.top = first;
+    }
+
+    ExtMoveList(const ExtMoveList &) = delete;
+    ExtMoveList &operator=(const ExtMoveList &) = delete;
+
+    iterator begin() {
+        return first;
+    }
+    iterator end() {
+        return last;
+    }
+    const_iterator begin() const {
+        return first;
+    }
+    const_iterator end() const {
+        return last;
+    }
+    size_type size() const {
+        return last - first;
+    }
+
+    void mark();
+    void unmark();
+    bool contains(Move m) const;
+    void insert(Move m, Score s = SCORE_NONE);
+    void swap(iterator it1, iterator it2);
+
+private:
+    MoveStack<S> &stack;
+    ExtMove *     first, *last;
+};
+
+// Set the marks of the moves in the list before generating more moves
+template <int S>
+inline void ExtMoveList<S>::mark() {
+    assert(stack.top == last);
+
+    for (auto &e : *this)
+        stack.marks.insert(e.move);
+}
+
+// Clear the marks of the moves in the list after generating, so that the marks
+// are all clear for the other lists. The new moves are pushed onto the stack.
+template <int S>
+inline void ExtMoveList<S>::unmark() {
+    for (auto &e : *this)
+        stack.marks.remove(e.move);
+    stack.top = last;
+}
+
+// Only valid between mark() and unmark()
+template <int S>
+inline bool ExtMoveList<S>::contains(Move m) const {
+    assert(is_ok(m, S));
+
+    return stack.marks.contains(m);
+}
+
+template <int S>
+inline void ExtMoveList<S>::insert(Move m, Score s) {
+    assert(is_ok(m, S));
+
+    if (!contains(m)) {
+        assert(last != stack.moves + MoveStack<S>::Capacity);
+
+        *last++ = {m, s};
+        stack.marks.insert(m);
+    }
+}
+
+template <int S>
+inline void ExtMoveList<S>::swap(iterator it1, iterator it2) {
+    assert(begin() <= it1 && it1 < end());
+    assert(begin() <= it2 && it2 < end());
+
+    ExtMove tmp = *it1;
+    *it1        = *it2;
+    *it2        = tmp;
+}
+
+template <int S>
+inline std::ostream &operator<<(std::ostream &os, const ExtMoveList<S> &ml) {
     for (auto &i : ml)
         std::cout << i << " ";
     return os;
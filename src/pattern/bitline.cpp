@@ -0,0 +1,313 @@
+/*      _____                __    ______
+ *     / ___ \              / /   /___  /
+ *    / /__/ /___  ____  __/ /_______/ /    ____  ____
+ *   / _____/ __ \/ __ \/_   _/ __  / /    / __ \/ __ \
+ *  / /    /  ___/ / / / / /_/ /_/ / /____/  ___/ / / /
+ * /_/     \____/_/ /_/ /___/\__,_/______/\____/_/ /_/
+ *
+ * PentaZen pattern generator, by Sun Yuliang.
+ */
+
+#include "bitline.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <initializer_list>
+#include <iostream>
+#include <memory.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Return the number of matches of any pattern found by successive searches like
+// std::string::find(), where each search starts skip positions after the last
+// match and only starts before limit
+int find_cnt(const BitLine &line, std::initializer_list<int> patterns, int patternLen, int skip, int limit) {
+    int ret = 0, pos = 0, p;
+
+    while (pos < limit) {
+        for (p = pos; p + patternLen <= line.size(); ++p)
+            if (std::find(patterns.begin(), patterns.end(), line.window(p, patternLen)) != patterns.end())
+                break;
+
+        if (p + patternLen > line.size())
+            break;
+
+        pos = p + skip;
+        ++ret;
+    }
+    return ret;
+}
+
+} // namespace
+
+// Return index of the leftmost piece
+int BitLine::start() const {
+    for (auto i = 0; i != len; ++i)
+        if (!is_empty(i))
+            return i;
+    return len;
+}
+
+// Return index of the rightmost piece
+int BitLine::end() const {
+    for (auto i = len - 1; i >= 0; --i)
+        if (!is_empty(i))
+            return i;
+    return -1;
+}
+
+// Return the number of occurrences of the pattern, overlapping ones included
+int BitLine::count(uint32_t pattern, int patternLen) const {
+    int ret = 0;
+
+    for (auto i = 0; i + patternLen <= len; ++i)
+        if (window(i, patternLen) == int(pattern))
+            ++ret;
+    return ret;
+}
+
+// Return the available pieces for material judgement. This can be too strict.
+int BitLine::piece_avail() const {
+    int ret = int(std::bitset<32>(mask).count());
+
+    for (auto i = C6; i != MATERIAL_NUM; ++i)
+        ret -= lookup(i) * piece_req_of(i);
+
+    return std::max(ret, 0);
+}
+
+template <>
+bool BitLine::judge_C6<FREESTYLE>() const {
+    return 0;
+}
+
+template <>
+bool BitLine::judge_C5<FREESTYLE>() const {
+    return count(0b11111, 5);
+}
+
+template <>
+int BitLine::judge_F4<FREESTYLE>() const {
+    return count(0b011110, 6);
+}
+
+template <>
+int BitLine::judge_F3<FREESTYLE>() const {
+    return find_cnt(*this, {0b001110, 0b010110, 0b011010, 0b011100}, 6, 4, len);
+}
+
+template <>
+bool BitLine::judge_C6<STANDARD>() const {
+    return count(0b111111, 6);
+}
+
+template <>
+bool BitLine::judge_C5<STANDARD>() const {
+    return len < 6 ? count(0b11111, 5) : (window(0, 6) == 0b111110) + count(0b0111110, 7) + (window(len - 6, 6) == 0b011111);
+}
+
+template <>
+int BitLine::judge_F4<STANDARD>() const {
+    return len < 7 ? count(0b011110, 6) : (window(0, 7) == 0b0111100) + count(0b00111100, 8) + (window(len - 7, 7) == 0b0011110);
+}
+
+template <>
+int BitLine::judge_F3<STANDARD>() const {
+    if (len <= 5)
+        return 0; // this is necessary
+
+    if (len == 6)
+        if (mask == 0b001110 || mask == 0b010110 || mask == 0b011010 || mask == 0b011100)
+            return 1;
+
+    // Search on the line with an empty position added at both ends
+    return find_cnt(BitLine(mask << 1, len + 2), {0b00011100, 0b00101100, 0b00110100, 0b00111000}, 8, 4, len);
+}
+
+// Return true if material m increases if adding a piece at pos. Return false if
+// no increase or pos is not empty.
+bool BitLine::judge_promotion(Material m, int pos) const {
+    if (!is_empty(pos))
+        return false;
+
+    BitLine tmp = *this;
+    bool    ret = false;
+    tmp.fill(pos);
+
+    if (tmp.lookup(m) > lookup(m)) {
+        ret = true;
+
+        // Check fake promotion. True promotion does not decrease the number of
+        // materials of higher or same priority to demote(m).
+        for (Material i = C6; !prior_to(demote(m), i); ++i) {
+            if (i == m || i == demote(m))
+                continue;
+
+            if (tmp.lookup(i) < lookup(i)) {
+                ret = false;
+                break;
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Return the number of material m in the line
+template <Rule r>
+int BitLine::judge(Material m) const {
+    int ret = 0, pa = piece_avail();
+
+    // Return if there are not enough pieces for material m
+    if (pa < piece_req_of(m))
+        return ret;
+
+    if (m == C6)
+        ret = judge_C6<r>();
+
+    else if (m == C5)
+        ret = judge_C5<r>();
+
+    else if (m == F4)
+        ret = judge_F4<r>();
+
+    else if (m == F3)
+        ret = judge_F3<r>();
+
+    else {
+        // Boundary for different material
+        int b = m == B4 ? 1 : m == B3 ? 2 :
+                          m == F2     ? 2 :
+                          m == B2     ? 3 :
+                          m == F1     ? 3 :
+                                        4;
+
+        // Judge by counting promotion positions
+        for (auto i = std::max(start() - b, 0); i <= std::min(end() + b, len - 1); ++i)
+            if (judge_promotion(promote(m), i))
+                ++ret;
+    }
+
+    // Transform ret to actual material number
+    switch (m) {
+    case B4:
+    case B3:
+    case B2:
+    case B1:
+        ret = ret < 5 - piece_req_of(m) ? 0 : ceil(ret / (5.0 - piece_req_of(m)));
+        break;
+    case F2:
+        ret = ret < 2 ? 0 : ceil(ret / 4.0);
+        break;
+    case F1:
+        ret = ret < 3 ? 0 : ceil(ret / 6.0);
+        break;
+    default:
+        break;
+    }
+
+    // Restrict the return value according to avaliable pieces
+    return std::min((int)(ceil((double)pa / piece_req_of(m))), ret);
+}
+
+// Call f on threadNum consecutive parts of [begin, end) in parallel
+void parallel_for(int begin, int end, int threadNum, const std::function<void(int, int)> &f) {
+    std::vector<std::thread> threads;
+    const int                step = (end - begin + threadNum - 1) / threadNum;
+
+    for (auto b = begin; b < end; b += step)
+        threads.emplace_back(f, b, std::min(b + step, end));
+
+    for (auto &th : threads)
+        th.join();
+}
+
+// Generate the whole table with threadNum threads. Judging a material looks up
+// the materials judged before on lines of the same length, so the materials are
+// judged one after another, each on lines of all lengths in parallel.
+void generate(Rule r, int threadNum) {
+    memset(MatTable, 0, sizeof(MatTable));
+
+    for (auto m = C6; m != MATERIAL_NUM; ++m)
+        parallel_for((1 << MIN_LINE_LEN) - 1, MAT_TABLE_SIZE - 1, threadNum, [&](int begin, int end) {
+            for (auto i = begin; i != end; ++i)
+                MatTable[i][m] = r == FREESTYLE ? line_of_index(i).judge<FREESTYLE>(m) : line_of_index(i).judge<STANDARD>(m);
+        });
+}
+
+// Return merged material info of the line
+uint32_t merged_material_info(const BitLine &line) {
+    uint32_t ret = 0;
+    int      cnt = 0, tmp;
+
+    // Skip lower level materials if C6, C5 or F4 exist
+    for (auto m = C6; m <= F4 && !cnt; ++m)
+        if (lookup(line, m) > 0)
+            ret |= m << (cnt++ * 4);
+
+    // Merge the remaining materials
+    if (!cnt)
+        for (auto m = B4; m <= B1; ++m) {
+            tmp = lookup(line, m);
+            while (tmp--)
+                ret |= m << (cnt++ * 4);
+        }
+
+    // This message should not be printed.
+    if (cnt > 8)
+        std::cerr << "material capacity is too small\n"
+                  << line.index() << std::endl;
+
+    // Fill with material none
+    while (cnt < 8)
+        ret |= MATERIAL_NONE << (cnt++ * 4);
+
+    return ret;
+}
+
+// Return merged position information for pos in line
+uint32_t merged_position_info(const BitLine &line, const int pos) {
+    if (line.size() < 5)
+        return 0;
+
+    if (!line.is_empty(pos))
+        return 0;
+
+    BitLine  tmp   = line;
+    BitLine  left  = line.sub(0, pos);
+    BitLine  right = line.sub(pos + 1, line.size() - 1 - pos);
+    uint32_t ret   = 0;
+
+    tmp.fill(pos);
+
+    // Promotion and demotion caused by filling my piece, bits 0 to 16
+    for (auto m = C6; m != MATERIAL_NUM; ++m) {
+        if (lookup(tmp, m) > lookup(line, m))
+            ret |= 1u << m;
+        if (m >= B4 && lookup(tmp, m) < lookup(line, m))
+            ret |= 1u << (m + 7);
+    }
+
+    // Promotion and demotion caused by filling opposite piece, bits 17 to 30
+    for (auto m = B4; m != MATERIAL_NUM; ++m) {
+        const int split = lookup(left, m) + lookup(right, m);
+
+        if (split > lookup(line, m))
+            ret |= 1u << (m + 14);
+        if (split < lookup(line, m))
+            ret |= 1u << (m + 21);
+    }
+
+    // XXX_X X_XXX for VCF
+    if (ret & 8 && line.size() >= 7) {
+        const int sz = line.size();
+
+        if ((2 <= pos && pos <= sz - 4 && line.window(pos - 2, 6) == 0b000110) || (3 <= pos && pos <= sz - 3 && line.window(pos - 3, 6) == 0b001010) || (4 <= pos && pos <= sz - 2 && line.window(pos - 4, 6) == 0b001100) || (1 <= pos && pos <= sz - 5 && line.window(pos - 1, 6) == 0b001100) || (2 <= pos && pos <= sz - 4 && line.window(pos - 2, 6) == 0b010100) || (3 <= pos && pos <= sz - 3 && line.window(pos - 3, 6) == 0b011000))
+            ret |= 1u << 31;
+    }
+
+    return ret;
+}
@@ -0,0 +1,124 @@
+/*      _____                __    ______
+ *     / ___ \              / /   /___  /
+ *    / /__/ /___  ____  __/ /_______/ /    ____  ____
+ *   / _____/ __ \/ __ \/_   _/ __  / /    / __ \/ __ \
+ *  / /    /  ___/ / / / / /_/ /_/ / /____/  ___/ / / /
+ * /_/     \____/_/ /_/ /___/\__,_/______/\____/_/ /_/
+ *
+ * PentaZen pattern generator, by Sun Yuliang.
+ */
+
+#pragma once
+
+#include "line.h"
+
+#include <cstdint>
+#include <functional>
+
+// BitLine class keeps the line as a bit mask, where position 0 of the line is
+// the most significant bit, as in the line index. Materials are judged with bit
+// operations on the mask and the results are the same as those of Line.
+class BitLine {
+public:
+    BitLine() = default;
+    BitLine(uint32_t ind, int len);
+
+    void set(uint32_t ind, int len);
+
+    int     size() const;
+    bool    is_empty(int pos) const;
+    void    fill(int pos);
+    int     index() const;
+    BitLine sub(int pos, int len) const;
+    int     window(int pos, int len) const;
+    template <Rule r>
+    int  judge(Material m) const;
+    bool judge_promotion(Material m, int pos) const;
+
+private:
+    uint32_t bit(int pos) const;
+    int      start() const;
+    int      end() const;
+    int      lookup(Material m) const;
+    int      piece_avail() const;
+    int      count(uint32_t pattern, int patternLen) const;
+    template <Rule r>
+    bool judge_C6() const;
+    template <Rule r>
+    bool judge_C5() const;
+    template <Rule r>
+    int judge_F4() const;
+    template <Rule r>
+    int judge_F3() const;
+
+    uint32_t mask = 0;
+    int      len  = 0;
+};
+
+inline BitLine::BitLine(uint32_t ind, int len) {
+    set(ind, len);
+}
+
+inline void BitLine::set(uint32_t ind, int l) {
+    mask = ind;
+    len  = l;
+}
+
+inline int BitLine::size() const {
+    return len;
+}
+
+inline uint32_t BitLine::bit(int pos) const {
+    return 1u << (len - 1 - pos);
+}
+
+inline bool BitLine::is_empty(int pos) const {
+    return !(mask & bit(pos));
+}
+
+inline void BitLine::fill(int pos) {
+    mask |= bit(pos);
+}
+
+inline int BitLine::index() const {
+    return int(mask) + (1 << len) - 1;
+}
+
+// Return the line of len positions from pos on
+inline BitLine BitLine::sub(int pos, int l) const {
+    return BitLine((mask >> (len - pos - l)) & ((1u << l) - 1), l);
+}
+
+// Return the bits of len positions from pos on
+inline int BitLine::window(int pos, int l) const {
+    return int((mask >> (len - pos - l)) & ((1u << l) - 1));
+}
+
+inline int BitLine::lookup(Material m) const {
+    return MatTable[index()][m];
+}
+
+inline int lookup(const BitLine &line, Material m) {
+    return MatTable[line.index()][m];
+}
+
+// Convert the index of the material table to the line, which can be a Line too
+template <typename L = BitLine>
+inline L line_of_index(int ind) {
+    L   line;
+    int len = 0;
+
+    while ((2 << len) <= ind + 1)
+        ++len;
+
+    line.set(uint32_t(ind + 1 - (1 << len)), len);
+    return line;
+}
+
+void parallel_for(int begin, int end, int threadNum, const std::function<void(int, int)> &f);
+
+void generate(Rule r, int threadNum);
+
+uint32_t merged_material_info(const BitLine &line);
+
+uint32_t merged_position_info(const BitLine &line, const int pos);
@@ -8,45 +8,264 @@
  * PentaZen pattern generator, by Sun Yuliang.
  */
 
-#include "line.h"
+#include "bitline.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
 
 // Global material table
 int MatTable[MAT_TABLE_SIZE][MATERIAL_NUM];
 
 namespace {
 
-// Output the whole table in c header file format
-void output_to_c_header_file() {
-    Line line;
+// Each row is padded to a power of 2 number of entries, so that rows are
+// aligned to 32 or 64 bytes and never cross a cache line
+constexpr int row_size() {
+    int size = 1;
+    while (size < MAX_LINE_LEN + 1)
+        size *= 2;
+    return size;
+}
+
+// Number of merged infos of a line: material info and position info of each
+// position
+constexpr int RowStride = MAX_LINE_LEN + 1;
+
+// Return merged material info and merged position info of all lines in the order
+// of output, computed by threadNum threads. L is Line or BitLine.
+template <typename L>
+std::vector<uint32_t> merged_rows(int threadNum) {
+    std::vector<uint32_t> rows(size_t(MAT_TABLE_SIZE - 1) * RowStride, 0);
+
+    parallel_for(0, MAT_TABLE_SIZE - 1, threadNum, [&](int begin, int end) {
+        for (auto i = begin; i != end; ++i) {
+            const L   line = line_of_index<L>(i);
+            uint32_t *row  = &rows[size_t(i) * RowStride];
+
+            *row++ = merged_material_info(line);
+            for (auto k = line.size() - 1; k >= 0; --k)
+                *row++ = merged_position_info(line, k);
+        }
+    });
+
+    return rows;
+}
+
+// Merged material info and merged position info take few distinct values, so
+// they are stored once in a value table and the rows only keep 16-bit indices
+// into it. Each row has the index of material info first, then the indices of
+// position info in the same order as before, and is padded with 0 to row_size().
+struct CompactTable {
+    std::vector<uint32_t> values;
+    std::vector<uint16_t> rows;
+};
+
+// Return the compact table of the merged infos. The values are numbered in the
+// order of first appearance and value 0 is always the first one.
+bool compact(const std::vector<uint32_t> &merged, CompactTable &table) {
+    std::map<uint32_t, int> valueIndex{{0, 0}};
+
+    table.values = {0};
+    table.rows.assign(size_t(MAT_TABLE_SIZE) * row_size(), 0);
+
+    auto index_of_value = [&](uint32_t v) {
+        auto it = valueIndex.find(v);
+        if (it != valueIndex.end())
+            return it->second;
+
+        table.values.push_back(v);
+        return valueIndex[v] = int(table.values.size()) - 1;
+    };
+
+    for (auto i = 0; i != MAT_TABLE_SIZE - 1; ++i) {
+        const int len = line_of_index(i).size();
 
-    std::string table_name = TARGET_RULE == FREESTYLE ? "Pattern_f" : "Pattern_s";
+        for (auto k = 0; k <= len; ++k)
+            table.rows[size_t(i) * row_size() + k] = uint16_t(index_of_value(merged[size_t(i) * RowStride + k]));
+    }
+
+    if (table.values.size() > 65536) {
+        std::cerr << "too many distinct values for 16-bit indices" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Output the whole table in c header file format. Names of the tables of lines
+// longer than 15 are prefixed by the length, e.g. Pattern_20_f.
+void output_to_c_header_file(const CompactTable &table) {
+    const std::string suffix = (MAX_LINE_LEN == 15 ? "" : "_" + std::to_string(MAX_LINE_LEN)) + (TARGET_RULE == FREESTYLE ? "_f" : "_s");
 
     std::cout << "#include <stdint.h>" << std::endl
               << std::endl;
-    std::cout << "static uint32_t " << table_name << "[" << MAT_TABLE_SIZE << "][" << MAX_LINE_LEN + 1 << "] = { ";
 
-    for (auto i = 0; i <= MAX_LINE_LEN; ++i)
-        for (auto j = 0; j != (1 << i); ++j) {
-            line.set(j, i);
-            std::cout << (i != 0 ? ",\n" : "\n") << "    { " << merged_material_info(line);
+    std::cout << "alignas(64) static const uint32_t PatternValue" << suffix << "[" << table.values.size() << "] = {";
+    for (size_t i = 0; i != table.values.size(); ++i)
+        std::cout << (i % 8 ? " " : "\n    ") << table.values[i] << (i + 1 != table.values.size() ? "," : "");
+    std::cout << "\n};" << std::endl
+              << std::endl;
 
-            for (auto i = line.size() - 1; i >= 0; --i)
-                std::cout << ", " << merged_position_info(line, i);
+    std::cout << "alignas(64) static const uint16_t Pattern" << suffix << "[" << MAT_TABLE_SIZE << "][" << row_size() << "] = { ";
+    for (auto i = 0; i != MAT_TABLE_SIZE - 1; ++i) {
+        const uint16_t *row = &table.rows[size_t(i) * row_size()];
 
-            std::cout << " }";
-        }
+        std::cout << (i != 0 ? ",\n" : "\n") << "    { " << row[0];
+
+        for (auto k = 1; k <= line_of_index(i).size(); ++k)
+            std::cout << ", " << row[k];
+
+        std::cout << " }";
+    }
 
     std::cout << "\n};" << std::endl;
 }
 
+// A binary pattern file consists of a header, zero padding up to DataOffset, the
+// rows and then the value table. The engine maps the data directly, so the offset
+// is a multiple of the page size and the Windows allocation granularity. The
+// layout must be kept the same as PatternFileHeader of the engine.
+constexpr char     PatternFileMagic[8] = {'P', 'Z', 'P', 'A', 'T', 'T', 'R', 'N'};
+constexpr uint32_t PatternFileVersion  = 1; // Increase when the format changes
+constexpr size_t   DataOffset          = 65536;
+
+struct PatternFileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t rule;
+    uint32_t lineLen;
+    uint32_t rowSize;
+    uint32_t rowCount;
+    uint32_t valueCount;
+    uint64_t checksum;
+};
+
+// Return the checksum of the rows and the values, FNV-1a style on 32-bit words
+uint64_t checksum(const CompactTable &table) {
+    uint64_t        h = 0xCBF29CE484222325ULL;
+    const uint32_t *w = reinterpret_cast<const uint32_t *>(table.rows.data());
+
+    for (size_t i = 0; i != table.rows.size() / 2; ++i)
+        h = (h ^ w[i]) * 0x100000001B3ULL;
+
+    for (auto v : table.values)
+        h = (h ^ v) * 0x100000001B3ULL;
+
+    return h;
+}
+
+// Output the whole table to a binary file which the engine loads at runtime
+bool output_to_binary_file(const CompactTable &table, const std::string &path) {
+    std::ofstream     ofs(path, std::ios::binary);
+    PatternFileHeader header;
+    std::vector<char> padding(DataOffset - sizeof(header), 0);
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, PatternFileMagic, sizeof(header.magic));
+    header.version    = PatternFileVersion;
+    header.rule       = TARGET_RULE;
+    header.lineLen    = MAX_LINE_LEN;
+    header.rowSize    = row_size();
+    header.rowCount   = MAT_TABLE_SIZE;
+    header.valueCount = uint32_t(table.values.size());
+    header.checksum   = checksum(table);
+
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(padding.data(), padding.size());
+    ofs.write(reinterpret_cast<const char *>(table.rows.data()), table.rows.size() * sizeof(uint16_t));
+    ofs.write(reinterpret_cast<const char *>(table.values.data()), table.values.size() * sizeof(uint32_t));
+    ofs.close();
+
+    return !ofs.fail();
+}
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(Clock::time_point t) {
+    return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+// Generate the tables of every rule with both the string based generator and the
+// bit based one, and check that the material tables and the merged infos are the
+// same. Return false on any difference.
+bool verify(int threadNum) {
+    bool ok = true;
+
+    for (auto r : {FREESTYLE, STANDARD}) {
+        Clock::time_point t = Clock::now();
+
+        generate(r);
+        const std::vector<int>      refMat(&MatTable[0][0], &MatTable[0][0] + MAT_TABLE_SIZE * MATERIAL_NUM);
+        const std::vector<uint32_t> refRows = merged_rows<Line>(1);
+        const double                refTime = seconds_since(t);
+
+        t = Clock::now();
+        generate(r, threadNum);
+        const std::vector<uint32_t> rows    = merged_rows<BitLine>(threadNum);
+        const double                bitTime = seconds_since(t);
+
+        const bool sameMat  = std::equal(refMat.begin(), refMat.end(), &MatTable[0][0]);
+        const bool sameRows = rows == refRows;
+
+        std::cerr << "rule " << r << ": string " << refTime << "s, bit " << bitTime << "s with " << threadNum << " threads, "
+                  << (sameMat && sameRows ? "identical" : "DIFFERENT") << std::endl;
+
+        if (!sameMat)
+            for (auto i = 0; i != MAT_TABLE_SIZE * MATERIAL_NUM; ++i)
+                if (refMat[i] != (&MatTable[0][0])[i]) {
+                    std::cerr << "first material difference at index " << i / MATERIAL_NUM << ", material " << i % MATERIAL_NUM << std::endl;
+                    break;
+                }
+
+        if (!sameRows)
+            for (size_t i = 0; i != rows.size(); ++i)
+                if (refRows[i] != rows[i]) {
+                    std::cerr << "first merged info difference at index " << i / RowStride << ", entry " << i % RowStride << std::endl;
+                    break;
+                }
+
+        ok = ok && sameMat && sameRows;
+    }
+
+    return ok;
+}
+
 } // namespace
 
-int main() {
-    generate(TARGET_RULE);
+// Usage: pattern [verify | binary [file]]
+// Without argument the table of TARGET_RULE is printed as a c header file. With
+// binary it is written to a binary file, pattern_15f.bin etc. by default. With
+// verify the bit based generator is checked against the string based one.
+int main(int argc, char *argv[]) {
+    const int    threadNum = std::max(1, int(std::thread::hardware_concurrency()));
+    CompactTable table;
+
+    if (argc > 1 && !strcmp(argv[1], "verify"))
+        return verify(threadNum) ? 0 : 1;
+
+    generate(TARGET_RULE, threadNum);
+
+    if (!compact(merged_rows<BitLine>(threadNum), table))
+        return 1;
+
+    if (argc > 1 && !strcmp(argv[1], "binary")) {
+        const std::string path = argc > 2 ? argv[2] : "pattern_" + std::to_string(MAX_LINE_LEN) + (TARGET_RULE == FREESTYLE ? "f" : "s") + ".bin";
+
+        if (!output_to_binary_file(table, path)) {
+            std::cerr << "failed to write " << path << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
-    output_to_c_header_file();
+    output_to_c_header_file(table);
 
     // Line line;
     // for (auto i = 0; i != (1 << MAX_LINE_LEN); ++i) {
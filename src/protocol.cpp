@@ -10,6 +10,7 @@
 
 #include "protocol.h"
 
+#include "dfpn.h"
 #include "thread.h"
 #include "tt.h"
 
@@ -23,15 +24,38 @@ void to_upper(std::string &str) {
             c = toupper(c);
 }
 
+// Solve the position of the board of side S and print the result
+template <int S>
+void solve(TimePoint time) {
+    TimeManagement timer;
+    DfpnSolver<S>  solver;
+    SolveResult    result = solver.solve(Threads.board<S>(), time);
+
+    sync_cout << "MESSAGE solve " << (result == SOLVE_WIN ? "win" : result == SOLVE_LOSS ? "loss" :
+                                                                                            "unknown")
+              << " nd " << solver.nodeCnt << " tm " << timer.elapsed();
+
+    if (result != SOLVE_UNKNOWN) {
+        std::cout << " pv";
+        for (auto i = 0; solver.proofLine[i]; ++i)
+            std::cout << " " << move_to_string(solver.proofLine[i], S);
+    }
+
+    std::cout << sync_endl;
+}
+
 } // namespace
 
-void loop() {
+void loop(int argc, char *argv[]) {
     std::string       cmd, sub_cmd;
     std::stringstream ss;
     Move              move;
     int               num, r, f;
     char              comma;
 
+    // Map the pattern tables next to the executable, if any
+    pattern_init(binary_directory(argv[0]));
+
     // Generate tables first
     search_init();
 
@@ -44,17 +68,30 @@ void loop() {
     // Print engine info
     sync_cout << engine_info() << sync_endl;
 
+    // Run the command line arguments as one command and quit, e.g. "bench 14 1 256"
+    if (argc > 1) {
+        for (auto i = 1; i < argc; ++i)
+            ss << argv[i] << " ";
+
+        ss >> cmd;
+        to_upper(cmd);
+
+        if (cmd == "BENCH")
+            bench(ss);
+        else
+            sync_cout << "ERROR unknown command " << cmd << sync_endl;
+        return;
+    }
+
     while (true) {
     top:
         std::cin >> cmd;
         to_upper(cmd);
 
-        // Stop all threads when receive a command
-        Threads.terminate = true;
-
-        // Wait until all threads have stopped
-        for (auto &i : Threads)
-            i->wait_for_search_finished();
+        // Stop all threads when receive a command. A ponder search goes on with
+        // the commands that could be a ponder hit or only update the time.
+        if (!Threads.pondering || (cmd != "INFO" && cmd != "TURN"))
+            Threads.stop();
 
         if (cmd == "ABOUT")
             sync_cout << "name=\"" << ENGINE_NAME << "\", version=\"" << ENGINE_VERSION << "\", author=\"" << ENGINE_AUTHOR << "\", country=\"China\"" << sync_endl;
@@ -62,6 +99,12 @@ void loop() {
         else if (cmd == "BEGIN")
             Threads.think_and_move();
 
+        else if (cmd == "BENCH") {
+            std::getline(std::cin, sub_cmd);
+            std::istringstream is(sub_cmd);
+            bench(is);
+        }
+
         else if (cmd == "BOARD" || cmd == "YXBOARD") {
             std::cin >> sub_cmd;
             to_upper(sub_cmd);
@@ -70,7 +113,7 @@ void loop() {
                 ss.clear();
                 ss << sub_cmd;
                 ss >> r >> comma >> f >> comma >> num;
-                if (!is_ok(move = make_move(r, f))) {
+                if (!is_ok(move = make_move(r, f), Threads.side)) {
                     sync_cout << "ERROR invalid move" << sync_endl;
                     goto top;
                 }
@@ -90,13 +133,16 @@ void loop() {
             std::cin >> sub_cmd;
             to_upper(sub_cmd);
 
+            if (Threads.pondering && sub_cmd != "TIME_LEFT" && sub_cmd != "TIMEOUT_MATCH" && sub_cmd != "TIMEOUT_TURN")
+                Threads.stop();
+
             if (sub_cmd == "HASH_SIZE") {
                 size_t kb;
                 std::cin >> kb;
                 TT.resize(kb / 1024);
             } else if (sub_cmd == "RULE") {
                 std::cin >> num;
-                if (BOARD_SIDE == 20 && num != FREESTYLE) {
+                if (Threads.side == 20 && num != FREESTYLE) {
                     sync_cout << "ERROR unsupported rule for this board size" << sync_endl;
                     goto top;
                 }
@@ -104,7 +150,14 @@ void loop() {
             } else if (sub_cmd == "THREAD_NUM") {
                 std::cin >> num;
                 Threads.set(num);
-            } else if (sub_cmd == "TIME_LEFT")
+            } else if (sub_cmd == "THREAD_BIND") {
+                // Threads are recreated to apply the binding
+                std::cin >> Threads.bindMode;
+                Threads.set(Threads.threadNum);
+            } else if (sub_cmd == "PONDER")
+                std::cin >> Threads.ponderMode;
+
+            else if (sub_cmd == "TIME_LEFT")
                 std::cin >> Threads.timeLeft;
 
             else if (sub_cmd == "TIMEOUT_MATCH")
@@ -124,10 +177,15 @@ void loop() {
 
         else if (cmd == "START") {
             std::cin >> num;
-            if (num != BOARD_SIDE) {
+            if (num != 15 && num != 20) {
                 sync_cout << "ERROR unsupported size" << sync_endl;
                 goto top;
             }
+            if (!pattern_available(num)) {
+                sync_cout << "ERROR pattern table of size " << num << " is missing" << sync_endl;
+                goto top;
+            }
+            Threads.set_side(num);
             Threads.reset();
             sync_cout << "OK" << sync_endl;
         }
@@ -139,10 +197,20 @@ void loop() {
 
         else if (cmd == "TURN") {
             std::cin >> r >> comma >> f;
-            if (!is_ok(move = make_move(r, f))) {
+            if (!is_ok(move = make_move(r, f), Threads.side)) {
                 sync_cout << "ERROR invalid move" << sync_endl;
                 goto top;
             }
+
+            // Ponder hit, the search goes on with the time of this turn
+            if (Threads.pondering) {
+                if (move == Threads.ponderMove) {
+                    Threads.ponderhit();
+                    goto top;
+                }
+                Threads.stop();
+            }
+
             Threads.do_move(move);
             Threads.think_and_move();
         }
@@ -152,6 +220,22 @@ void loop() {
             Threads.clear_history(); // Clear histories as well
         }
 
+        else if (cmd == "YXLOADHASH") {
+            std::getline(std::cin >> std::ws, sub_cmd);
+            if (TT.load_file(sub_cmd))
+                sync_cout << "MESSAGE hash loaded from " << sub_cmd << sync_endl;
+            else
+                sync_cout << "ERROR failed to load hash from " << sub_cmd << sync_endl;
+        }
+
+        else if (cmd == "YXSAVEHASH") {
+            std::getline(std::cin >> std::ws, sub_cmd);
+            if (TT.save_file(sub_cmd))
+                sync_cout << "MESSAGE hash saved to " << sub_cmd << sync_endl;
+            else
+                sync_cout << "ERROR failed to save hash to " << sub_cmd << sync_endl;
+        }
+
         else if (cmd == "YXSHOWFORBID") {
             if (Threads.rule == RENJU) {
                 sync_cout << "FORBID ";
@@ -167,10 +251,17 @@ void loop() {
             sync_cout << "MESSAGE INFO MAX_HASH_SIZE 24\n"
                       << "MESSAGE INFO MAX_THREAD_NUM 32" << sync_endl;
         }
+
+        else if (cmd == "YXSOLVE") {
+            TimePoint time;
+
+            std::cin >> time;
+            Threads.side == 20 ? solve<20>(time) : solve<15>(time);
+        }
 #ifndef NDEBUG
         else if (cmd == "D") {
             std::cin >> r >> comma >> f;
-            if (!is_ok(move = make_move(r, f))) {
+            if (!is_ok(move = make_move(r, f), Threads.side)) {
                 sync_cout << "ERROR invalid move" << sync_endl;
                 goto top;
             }
@@ -181,7 +272,7 @@ void loop() {
             Threads.undo_move();
 
         else if (cmd == "P")
-            sync_cout << Threads.main()->bd << sync_endl;
+            Threads.side == 20 ? sync_cout << Threads.board<20>() << sync_endl : sync_cout << Threads.board<15>() << sync_endl;
 #endif
     }
 }
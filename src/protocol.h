@@ -10,4 +10,7 @@
 
 #pragma once
 
-void loop();
+#include <istream>
+
+void loop(int argc, char *argv[]);
+void bench(std::istream &is);
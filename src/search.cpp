@@ -22,6 +22,19 @@ namespace {
 constexpr int SkipSize[20]  = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
 constexpr int SkipPhase[20] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
 
+// Aspiration window half width at the first try and the minimum iteration depth
+// to use aspiration windows
+constexpr int   AspirationDelta = 80;
+constexpr Depth AspirationDepth = Depth(5);
+
+// VCT depth tried at alphabeta leaves not deeper than the ply limit. The root
+// VCT deepens in the depth range with a share of the turn time.
+constexpr Depth VctLeafDepth    = Depth(5);
+constexpr Depth VctLeafPlyMax   = Depth(4);
+constexpr Depth VctRootDepthMin = Depth(5);
+constexpr Depth VctRootDepthMax = Depth(21);
+constexpr int   VctRootTimeDiv  = 8;
+
 int   FutilityMoveCount[2][DEPTH_NUM];    // [quiet][depth]
 Depth Reduction[2][DEPTH_NUM][MOVE_SIZE]; // [pv][depth][moveCnt]
 
@@ -33,8 +46,8 @@ constexpr bool is_empty(const Pv &pv) {
     return pv[0] == MOVE_NONE;
 }
 
-inline void reset_pv(Pv &pv) {
-    pv[0] = MOVE_NONE;
+inline void reset_pv(Pv *pv, Depth ply) {
+    (*pv)[ply] = MOVE_NONE;
 }
 
 inline Score score_to_tt(Score sc, Depth ply) {
@@ -47,33 +60,26 @@ inline Score score_from_tt(Score sc, Depth ply) {
                                                                              sc;
 }
 
-// Update pv by adding current move only
-void update_pv(Pv *pv, Move m) {
-    (*pv)[0] = m;
-    (*pv)[1] = MOVE_NONE;
+// Update pv of the node at ply by adding current move only
+void update_pv(Pv *pv, Depth ply, Move m) {
+    (*pv)[ply]     = m;
+    (*pv)[ply + 1] = MOVE_NONE;
 }
 
-// Update pv by adding current move and appending child pv
-void update_pv(Pv *pv, Move m, const Pv *childPv) {
-    auto i   = 0;
-    (*pv)[0] = m;
-
-    while ((*childPv)[i++])
-        (*pv)[i] = (*childPv)[i - 1];
-
-    (*pv)[i] = MOVE_NONE;
+// Update pv of the node at ply by adding current move and splicing the child pv.
+// The child pv is at the same indices of its row, so the rows are swapped
+// instead of copying the moves.
+void update_pv(SearchStack &ss, Depth ply, Move m) {
+    std::swap(ss[ply].pv, ss[ply + 1].pv);
+    (*ss[ply].pv)[ply] = m;
 }
 
-// Update pv by adding two moves and appending child pv
-void update_pv(Pv *pv, Move m0, Move m1, const Pv *childPv) {
-    auto i   = 0;
-    (*pv)[0] = m0;
-    (*pv)[1] = m1;
-
-    while ((*childPv)[i++])
-        (*pv)[i + 1] = (*childPv)[i - 1];
-
-    (*pv)[i + 1] = MOVE_NONE;
+// Update pv of the node at ply by adding two moves and splicing the pv of the
+// grandchild
+void update_pv(SearchStack &ss, Depth ply, Move m0, Move m1) {
+    std::swap(ss[ply].pv, ss[ply + 2].pv);
+    (*ss[ply].pv)[ply]     = m0;
+    (*ss[ply].pv)[ply + 1] = m1;
 }
 
 } // namespace
@@ -97,8 +103,9 @@ void search_init() {
 // Thread::reset_alphabeta() should be called before each alphabeta iteration
 void Thread::reset_alphabeta() {
     ply = DEPTH_ZERO;
-    reset_pv(rootPv);
-    ss[0].pv = &rootPv;
+    for (auto i = 0; i != int(pvTable.size()); ++i)
+        ss[i].pv = &pvTable[i];
+    reset_pv(ss[0].pv, DEPTH_ZERO);
 }
 
 // Thread::reset_search() should be called before the whole search
@@ -106,7 +113,10 @@ void Thread::reset_search() {
     plyMax  = DEPTH_ZERO;
     itDepth = DEPTH_ITERATIVE_MIN;
     nodeCnt = 0;
+    vctTime = 2147483647;
+    vctStop = false;
     rootBests.clear();
+    vcfTable.hits = vcfTable.misses = 0;
     reset_alphabeta();
 }
 
@@ -142,12 +152,14 @@ void Thread::print_message() const {
 
     std::cout << " tm " << Threads.timer.elapsed() + 1;
     std::cout << " sp " << nodeCnt / (Threads.timer.elapsed() + 1); // add one to avoid divided by 0
+    std::cout << " rs " << rem.researches;
+    std::cout << " vc " << Threads.get_vcf_hits() << "/" << Threads.get_vcf_hits() + Threads.get_vcf_misses();
 
     if (Threads.yxprotocol && !is_empty(rem.pv)) {
         std::cout << " pv";
         for (auto i = 0; rem.pv[i]; ++i) {
-            assert(is_ok(rem.pv[i]));
-            std::cout << " " << rem.pv[i];
+            assert(is_ok(rem.pv[i], Threads.side));
+            std::cout << " " << move_to_string(rem.pv[i], Threads.side);
         }
     }
 
@@ -155,11 +167,30 @@ void Thread::print_message() const {
 }
 
 // MainThread::search() is called by the main thread to search from the root
-// position and output the result to GUI
+// position and output the result to GUI. In ponder mode, it goes on searching
+// the expected reply of the opponent until the ponder search is stopped.
 void MainThread::search() {
+    while (think())
+        if (!Threads.ponderMode || !Threads.start_pondering())
+            break;
+}
+
+// MainThread::think() without side parameter dispatches to the board of the
+// current side
+bool MainThread::think() {
+    return Threads.side == 20 ? think<20>() : think<15>();
+}
+
+// MainThread::think() searches the root position and outputs the best move.
+// Returns false if it is a ponder search that has been stopped, in which case
+// no move is output.
+template <int S>
+bool MainThread::think() {
+    Board<S> &bd = board<S>();
+
     assert(bd.check_wld_already() == PIECE_NONE);
 
-    MoveGen     mg(&bd);
+    MoveGen<S>  mg(&bd);
     RootExtMove rem;
     ExtMove     em;
     int         offset;
@@ -172,30 +203,49 @@ void MainThread::search() {
     if (!skipSearch && bd.is_empty()) {
         rem.score = SCORE_ZERO;
         rem.depth = Depth(1);
-        update_pv(&rem.pv, make_move(BOARD_SIDE / 2, BOARD_SIDE / 2));
+        update_pv(&rem.pv, DEPTH_ZERO, make_move(S / 2, S / 2));
         skipSearch = true;
     }
 
     // Check for win/lose/draw
     if (!skipSearch && bd.check_wld(offset) != PIECE_NONE) {
-        em        = mg.generate<WLD>();
+        em        = mg.template generate<WLD>();
         rem.score = em.score;
         rem.depth = Depth(offset);
-        update_pv(&rem.pv, em.move);
+        update_pv(&rem.pv, DEPTH_ZERO, em.move);
         skipSearch = true;
     }
 
     // Check for unique move
     if (!skipSearch) {
-        em = mg.generate<MAIN>();
+        em = mg.template generate<MAIN>();
         if (mg.size() == 1) {
             rem.score = SCORE_ZERO;
             rem.depth = Depth(1);
-            update_pv(&rem.pv, em.move);
+            update_pv(&rem.pv, DEPTH_ZERO, em.move);
             skipSearch = true;
         }
     }
 
+    // Try VCT with a share of the turn time before the full search
+    if (!skipSearch) {
+        vctTime = Threads.turnTime / VctRootTimeDiv;
+
+        for (Depth d = VctRootDepthMin; d <= VctRootDepthMax && !vctStop && !Threads.terminate; d += 2) {
+            reset_alphabeta();
+
+            Score score = vct(d);
+
+            if (score > SCORE_WIN_THRESHOLD) {
+                rem.set(score, d, *ss[0].pv);
+                skipSearch = true;
+                break;
+            }
+        }
+
+        vctTime = 2147483647;
+    }
+
     if (skipSearch) {
         // Check if could skip searching
         rootBests.emplace_back(rem);
@@ -215,6 +265,18 @@ void MainThread::search() {
         if (th != this)
             th->wait_for_search_finished();
 
+    // A ponder search that has finished by itself waits for the ponder hit
+    const bool ponderhit = Threads.wait_for_ponder_end();
+
+    Threads.timeKeeper.stop();
+
+    if (!ponderhit)
+        return false;
+
+    // Report how late the search stopped after the deadline of the turn
+    if (Threads.timeKeeper.stopLatency >= 0)
+        sync_cout << "MESSAGE stop latency " << Threads.timeKeeper.stopLatency << "ms" << sync_endl;
+
     Move bestMove = Threads.get_best_thread()->rootBests.back().pv[0];
 
     // Update the boards in all threads
@@ -222,6 +284,8 @@ void MainThread::search() {
 
     // Output the result
     sync_cout << rank_of(bestMove) << "," << file_of(bestMove) << sync_endl;
+
+    return true;
 }
 
 // Thread::search() is the main iterative deepening loop. It calls alphabeta()
@@ -243,12 +307,12 @@ void Thread::search() {
             }
         }
 
-        reset_alphabeta();
-        score = alphabeta<PV>(-SCORE_INF, SCORE_INF, itDepth, false);
-        rem.set(score, itDepth, rootPv);
+        score = aspiration_search();
+        rem.set(score, itDepth, *ss[0].pv);
+        rem.researches = researches;
 
         // Have not fully searched any child of the root node. Abort and stop.
-        if (Threads.terminate && is_empty(rootPv))
+        if (Threads.terminate && is_empty(*ss[0].pv))
             validResult = false;
 
         // Stop the iteration if we have exceeded the time limit or have found the
@@ -284,7 +348,7 @@ void Thread::search() {
                 sync_cout << "MESSAGE REALTIME BEST " << rank_of(rem.pv[0]) << "," << file_of(rem.pv[0]) << sync_endl;
         }
 
-        if (!breakSearch && itDepth < DEPTH_ITERATIVE_MAX) {
+        if (!breakSearch && itDepth < Threads.depthLimit) {
             // Print every iteration message in yixin board
             if (Threads.yxprotocol && this == Threads.get_best_thread())
                 print_message();
@@ -305,10 +369,10 @@ void Thread::search() {
 
                 // Update turn time
                 Threads.turnTime = static_cast<TimePoint>(Threads.turnTime * timeIncrease);
-                Threads.turnTime = std::clamp(Threads.turnTime, Threads.turnTimeMin, Threads.turnTimeMax);
+                Threads.turnTime = std::clamp(Threads.turnTime.load(), Threads.turnTimeMin, Threads.turnTimeMax);
 
                 // Terminate if we do not have enough time for the next iteration
-                if (Threads.timer.elapsed() > Threads.turnTime * 0.7) {
+                if (!Threads.pondering && Threads.timeKeeper.elapsed() > Threads.turnTime * 0.7) {
                     Threads.terminate = true;
                     break;
                 }
@@ -327,16 +391,67 @@ void Thread::search() {
     }
 }
 
+// Thread::aspiration_search() searches the root node at the current iteration
+// depth. The window is centred on the score of the last iteration and widened
+// after each fail low or fail high until the score falls inside. Win and lose
+// scores are always searched with an open bound.
+Score Thread::aspiration_search() {
+    Score alpha = -SCORE_INF, beta = SCORE_INF, score;
+    int   delta = AspirationDelta;
+
+    researches = 0;
+
+    if (itDepth >= AspirationDepth && !rootBests.empty() && abs(rootBests.back().score) < SCORE_WIN_THRESHOLD) {
+        alpha = Score(std::max(int(rootBests.back().score) - delta, -int(SCORE_WIN_THRESHOLD)));
+        beta  = Score(std::min(int(rootBests.back().score) + delta, int(SCORE_WIN_THRESHOLD)));
+    }
+
+    while (true) {
+        reset_alphabeta();
+        score = alphabeta(alpha, beta, itDepth);
+
+        if (Threads.terminate)
+            break;
+
+        // Fail low. Also pull beta down to get a faster fail low re-search.
+        if (score <= alpha) {
+            beta  = Score((int(alpha) + beta) / 2);
+            alpha = score <= -SCORE_WIN_THRESHOLD ? -SCORE_INF : Score(std::max(int(score) - delta, -int(SCORE_WIN_THRESHOLD)));
+        }
+
+        // Fail high
+        else if (score >= beta)
+            beta = score >= SCORE_WIN_THRESHOLD ? SCORE_INF : Score(std::min(int(score) + delta, int(SCORE_WIN_THRESHOLD)));
+
+        else
+            break;
+
+        ++researches;
+        delta *= 2;
+    }
+
+    return score;
+}
+
+// Thread::alphabeta() without side and rule parameters starts a pv search from
+// the root node. The side and the rule are dispatched here once, so that the
+// whole search tree runs in the instantiation of the current side and rule. The
+// 20x20 board is played with freestyle only.
+Score Thread::alphabeta(Score alpha, Score beta, Depth depth) {
+    return Threads.side == 20           ? alphabeta<20, FREESTYLE, PV>(alpha, beta, depth, false) :
+           Threads.rule == FREESTYLE ? alphabeta<15, FREESTYLE, PV>(alpha, beta, depth, false) :
+           Threads.rule == STANDARD  ? alphabeta<15, STANDARD, PV>(alpha, beta, depth, false) :
+                                       alphabeta<15, RENJU, PV>(alpha, beta, depth, false);
+}
+
 // Thread::alphabeta() is the search function for both pv and non-pv nodes
-template <NodeType NT>
+template <int S, Rule R, NodeType NT>
 Score Thread::alphabeta(Score alpha, Score beta, Depth depth, bool cautious) {
-    // Check stop search
-    if (Threads.terminate)
-        return ply & 1u ? SCORE_WIN : -SCORE_WIN;
+    Board<S> &bd = board<S>();
 
-    // Check timeout
-    if ((nodeCnt & 511u) == 511u && Threads.timer.elapsed() > Threads.turnTime)
-        Threads.terminate = true;
+    // Check stop search. Timeout is checked by the time keeper.
+    if (Threads.terminate.load(std::memory_order_relaxed))
+        return ply & 1u ? SCORE_WIN : -SCORE_WIN;
 
     // Update search stats
     plyMax = std::max(plyMax, ply);
@@ -348,7 +463,7 @@ Score Thread::alphabeta(Score alpha, Score beta, Depth depth, bool cautious) {
     int        offset;
 
     // Check for win/lose/draw
-    if ((piece = bd.check_wld(offset)) != PIECE_NONE)
+    if ((piece = bd.template check_wld<R>(offset)) != PIECE_NONE)
         return piece == bd.sideToMove ? SCORE_WIN - ply - offset : piece == bd.oppoToMove ? -SCORE_WIN + ply + offset :
                                                                piece == PIECE_DRAW        ? SCORE_DRAW :
                                                                                             SCORE_NONE;
@@ -369,7 +484,11 @@ Score Thread::alphabeta(Score alpha, Score beta, Depth depth, bool cautious) {
     // Return when depth reaches zero or ply reaches max depth
     if (depth <= DEPTH_ZERO || ply >= DEPTH_MAX) {
         // Try VCF to beat beta
-        if (staticScore < beta && bd.query(bd.sideToMove, B3) > 0 && (score = vcf<NT>(vcfDepth, true)) > SCORE_WIN_THRESHOLD)
+        if (staticScore < beta && bd.query(bd.sideToMove, B3) > 0 && (score = vcf<S, R, NT>(vcfDepth, true)) > SCORE_WIN_THRESHOLD)
+            return score;
+
+        // Try VCT to beat beta near the root if opponent has no threat
+        if (staticScore < beta && ply <= VctLeafPlyMax && bd.query(bd.oppoToMove, B4) == 0 && bd.query(bd.oppoToMove, F3) == 0 && bd.query(bd.sideToMove, F2) + bd.query(bd.sideToMove, B3) >= 2 && (score = vct<S, R, NT>(VctLeafDepth, true)) > SCORE_WIN_THRESHOLD)
             return score;
 
         // Return static evaluation
@@ -380,9 +499,8 @@ Score Thread::alphabeta(Score alpha, Score beta, Depth depth, bool cautious) {
     Move       bestMove, ttMove;
     Score      bestScore, ttScore;
     Depth      newDepth;
-    TTEntry *  tte;
+    TTEntry    tte;
     ZobristKey key;
-    Pv         childPv;
     int        moveCnt;
     bool       ttHit, defendB4, quietNode, extend, doFullDepthSearch;
 
@@ -396,40 +514,37 @@ Score Thread::alphabeta(Score alpha, Score beta, Depth depth, bool cautious) {
     ttMove    = MOVE_NONE;
     bestScore = -SCORE_INF;
     ttScore   = SCORE_NONE;
-    tte       = nullptr;
     key       = bd.key;
     moveCnt   = 0;
     ttHit     = false;
     defendB4  = bd.query(bd.oppoToMove, B4) > 0;
     quietNode = bd.is_quiet();
     extend    = false;
-    reset_pv(childPv);
 
     ss[ply + 2].killers[0] = MOVE_NONE;
     ss[ply + 2].killers[1] = MOVE_NONE;
 
     // Transposition table lookup
     tte     = TT.probe(key, ttHit);
-    ttMove  = rootNode && !rootBests.empty() ? rootBests.back().pv[0] : ttHit ? tte->move() :
+    ttMove  = rootNode && !rootBests.empty() ? rootBests.back().pv[0] : ttHit ? tte.move() :
                                                                                 MOVE_NONE;
-    ttScore = rootNode && !rootBests.empty() ? rootBests.back().score : ttHit ? score_from_tt(tte->score(), ply) :
+    ttScore = rootNode && !rootBests.empty() ? rootBests.back().score : ttHit ? score_from_tt(tte.score(), ply) :
                                                                                 SCORE_NONE;
 
     // TT cutoff: win move
-    if (!PvNode && ttHit && ttScore > SCORE_WIN_THRESHOLD && (tte->bound() & BOUND_LOWER)) {
+    if (!PvNode && ttHit && ttScore > SCORE_WIN_THRESHOLD && (tte.bound() & BOUND_LOWER)) {
         // Update history
         if (ttScore >= beta)
-            update_history(ttMove);
+            update_history<S>(ttMove);
 
         return ttScore;
     }
 
     // TT cutoff: fail high/low move
-    if (!PvNode && ttHit && tte->depth() >= depth && ttScore != SCORE_NONE // Possible in case of TT access race
-        && (ttScore >= beta ? (tte->bound() & BOUND_LOWER) : (tte->bound() & BOUND_UPPER))) {
+    if (!PvNode && ttHit && tte.depth() >= depth && (ttScore >= beta ? (tte.bound() & BOUND_LOWER) : (tte.bound() & BOUND_UPPER))) {
         // Update history
         if (ttScore >= beta)
-            update_history(ttMove);
+            update_history<S>(ttMove);
 
         return ttScore;
     }
@@ -439,12 +554,12 @@ Score Thread::alphabeta(Score alpha, Score beta, Depth depth, bool cautious) {
         goto moves_loop;
 
     // Check if the score in TT is more accurate
-    if (ttHit && (tte->bound() & (ttScore > staticScore ? BOUND_LOWER : BOUND_UPPER)))
+    if (ttHit && (tte.bound() & (ttScore > staticScore ? BOUND_LOWER : BOUND_UPPER)))
         staticScore = ttScore;
 
     // Razoring
     if (!rootNode && depth < 5 && staticScore + futility_margin(depth) <= alpha)
-        return alphabeta<NT>(alpha, beta, DEPTH_ZERO, cautious);
+        return alphabeta<S, R, NT>(alpha, beta, DEPTH_ZERO, cautious);
 
     // Extended Futility pruning
     if (!rootNode && depth < 7 && staticScore - futility_margin(depth) >= beta && staticScore < SCORE_WIN_THRESHOLD) // Do not return not verified wins
@@ -452,16 +567,16 @@ Score Thread::alphabeta(Score alpha, Score beta, Depth depth, bool cautious) {
 
     // Internal iterative deepening
     if (depth >= 7 && ttMove == MOVE_NONE) {
-        alphabeta<NT>(alpha, beta, depth / 2, cautious);
+        alphabeta<S, R, NT>(alpha, beta, depth / 2, cautious);
 
         tte     = TT.probe(key, ttHit);
-        ttMove  = ttHit ? tte->move() : MOVE_NONE;
-        ttScore = ttHit ? score_from_tt(tte->score(), ply) : SCORE_NONE;
+        ttMove  = ttHit ? tte.move() : MOVE_NONE;
+        ttScore = ttHit ? score_from_tt(tte.score(), ply) : SCORE_NONE;
     }
 
 moves_loop:
     Move    cm = bd.pieceCnt >= 1 ? counterMoves[bd.last_move(1)] : MOVE_NONE;
-    MoveGen mg(&bd, MAIN_TT, ttMove, false, ply, ss[ply].killers, cm);
+    MoveGen<S> mg(&bd, MAIN_TT, ttMove, false, ply, ss[ply].killers, cm);
 
     // Loop through all moves until no moves remain or a beta cutoff occurs
     while ((em = mg.next_move()).move != MOVE_NONE) {
@@ -493,8 +608,10 @@ moves_loop:
         assert(DEPTH_ZERO <= newDepth && newDepth <= DEPTH_MAX);
 
         // Make the move
-        ss[++ply].pv = &childPv;
-        bd.do_move(em.move);
+        ++ply;
+        if (PvNode)
+            reset_pv(ss[ply].pv, ply);
+        bd.template do_move<R>(em.move);
 
         // LMR Search. Moves will be re-searched at full depth if fail high.
         if (depth >= 3 && moveCnt > 1) {
@@ -502,7 +619,7 @@ moves_loop:
 
             Depth d = std::clamp(newDepth - r, Depth(1), newDepth);
 
-            score = -alphabeta<NonPV>(-alpha - 1, -alpha, d, cautious);
+            score = -alphabeta<S, R, NonPV>(-alpha - 1, -alpha, d, cautious);
 
             doFullDepthSearch = score > alpha && d != newDepth;
         } else
@@ -510,21 +627,21 @@ moves_loop:
 
         // Full depth search when LMR is skipped or fails high
         if (doFullDepthSearch)
-            score = -alphabeta<NonPV>(-alpha - 1, -alpha, newDepth, cautious);
+            score = -alphabeta<S, R, NonPV>(-alpha - 1, -alpha, newDepth, cautious);
 
         // For pv nodes only, do a full pv search on the first move or after a fail
         // high (in the latter case search only if score < beta), otherwise let the
         // parent node fail low with score <= alpha and try another move.
         if (PvNode && (moveCnt == 1 || (score > alpha && (rootNode || score < beta))))
-            score = -alphabeta<PV>(-beta, -alpha, newDepth, cautious);
+            score = -alphabeta<S, R, PV>(-beta, -alpha, newDepth, cautious);
 
         // Do verification search if we find a win move
         if (PvNode && ply >= 2 && !cautious && score > SCORE_WIN_THRESHOLD) {
-            Score s = -alphabeta<PV>(-SCORE_WIN_THRESHOLD, -SCORE_WIN_THRESHOLD + 1, newDepth, true);
+            Score s = -alphabeta<S, R, PV>(-SCORE_WIN_THRESHOLD, -SCORE_WIN_THRESHOLD + 1, newDepth, true);
 
             // If fails low, do cautious re-search
             if (s < SCORE_WIN_THRESHOLD)
-                score = -alphabeta<PV>(-beta, -alpha, newDepth, true);
+                score = -alphabeta<S, R, PV>(-beta, -alpha, newDepth, true);
         }
 
         // Un-make the move
@@ -544,10 +661,8 @@ moves_loop:
 
                 // Do not update pv when fails high at root node. This may happen
                 // when aspiration windows are applied
-                if (PvNode && (!rootNode || score < beta)) {
-                    assert(ss[ply + 1].pv);
-                    update_pv(ss[ply].pv, em.move, ss[ply + 1].pv);
-                }
+                if (PvNode && (!rootNode || score < beta))
+                    update_pv(ss, ply, em.move);
 
                 // Update alpha
                 if (PvNode && score < beta)
@@ -562,20 +677,22 @@ moves_loop:
 
     // Update history
     if (bestMove != MOVE_NONE)
-        update_history(bestMove);
+        update_history<S>(bestMove);
 
     // Save results in TT
     Bound bound = bestScore >= beta ? BOUND_LOWER : PvNode && bestMove != MOVE_NONE ? BOUND_EXACT :
                                                                                       BOUND_UPPER;
-    tte->save(key, bestMove, score_to_tt(bestScore, ply), bound, false, depth);
+    TT.save(key, bestMove, score_to_tt(bestScore, ply), bound, false, depth);
 
     assert(is_ok(bestScore));
 
     return bestScore;
 }
 
-template <NodeType NT>
+template <int S, Rule R, NodeType NT>
 Score Thread::vcf(Depth depth, bool rootNode) {
+    Board<S> &bd = board<S>();
+
     const bool PvNode = NT == PV;
     Piece      piece;
     int        offset;
@@ -586,7 +703,7 @@ Score Thread::vcf(Depth depth, bool rootNode) {
         ++nodeCnt;
 
         // Check for win/lose/draw
-        if ((piece = bd.check_wld(offset)) != PIECE_NONE)
+        if ((piece = bd.template check_wld<R>(offset)) != PIECE_NONE)
             return piece == bd.sideToMove ? SCORE_WIN - ply - offset : piece == bd.oppoToMove ? -SCORE_WIN + ply + offset :
                                                                    piece == PIECE_DRAW        ? SCORE_DRAW :
                                                                                                 SCORE_NONE;
@@ -600,17 +717,27 @@ Score Thread::vcf(Depth depth, bool rootNode) {
     assert(DEPTH_ZERO <= ply && ply < DEPTH_MAX);
 
     ExtMove em;
-    Move    b4d;
+    Move    b4d, bestMove, area;
     Score   score, bestScore;
-    Pv      childPv;
     int     moveCnt;
 
     // Initialization
+    bestMove  = MOVE_NONE;
     bestScore = -SCORE_INF;
+    area      = rootNode ? MOVE_NONE : bd.last_move(2);
     moveCnt   = 0;
-    reset_pv(childPv);
 
-    MoveGen mg(&bd, VCF_TT, MOVE_NONE, rootNode);
+    // VCF cache cutoff. A win is valid at any depth and no win is valid up to the
+    // searched depth. Pv nodes search a cached win again to get the full pv.
+    const VcfEntry *ve = vcfTable.probe(bd.key, bd.sideToMove, area);
+
+    if (ve && (ve->move != MOVE_NONE ? !PvNode : ve->depth >= depth)) {
+        ++vcfTable.hits;
+        return ve->move != MOVE_NONE ? SCORE_WIN - ply - ve->distance : SCORE_ZERO;
+    }
+    ++vcfTable.misses;
+
+    MoveGen<S> mg(&bd, VCF_TT, MOVE_NONE, rootNode);
 
     // Loop through all moves until no moves remain or a win move is found
     while ((em = mg.next_move()).move != MOVE_NONE) {
@@ -622,19 +749,21 @@ Score Thread::vcf(Depth depth, bool rootNode) {
 
         // Make the move to form B4
         ply += 2;
-        ss[ply].pv = &childPv;
-        bd.do_move(em.move);
+        if (PvNode)
+            reset_pv(ss[ply].pv, ply);
+        bd.template do_move<R>(em.move);
 
         // Check sudden win/lose/draw
-        if ((piece = bd.check_wld(offset)) != PIECE_NONE) {
+        if ((piece = bd.template check_wld<R>(offset)) != PIECE_NONE) {
             bd.undo_move();
             ply -= 2;
 
             if (piece == bd.sideToMove) {
+                bestMove  = em.move;
                 bestScore = SCORE_WIN - ply - offset;
 
                 if (PvNode)
-                    update_pv(ss[ply].pv, em.move);
+                    update_pv(ss[ply].pv, ply, em.move);
                 break;
             } else {
                 --moveCnt;
@@ -643,9 +772,9 @@ Score Thread::vcf(Depth depth, bool rootNode) {
         }
 
         // Make the move to defend B4
-        bd.do_move(b4d = bd.defend_B4());
+        bd.template do_move<R>(b4d = bd.defend_B4());
 
-        score = vcf<NT>(depth - 2, false);
+        score = vcf<S, R, NT>(depth - 2, false);
 
         // Un-make two moves
         bd.undo_move();
@@ -654,15 +783,197 @@ Score Thread::vcf(Depth depth, bool rootNode) {
 
         // Break once a win move is found
         if (score > SCORE_WIN_THRESHOLD) {
+            bestMove  = em.move;
             bestScore = score;
 
-            if (PvNode) {
-                assert(ss[ply + 2].pv);
-                update_pv(ss[ply].pv, em.move, b4d, ss[ply + 2].pv);
-            }
+            if (PvNode)
+                update_pv(ss, ply, em.move, b4d);
+            break;
+        }
+    }
+
+    // Save the result in VCF cache
+    vcfTable.save(bd.key, bd.sideToMove, area, bestMove, depth, bestMove != MOVE_NONE ? int(SCORE_WIN - bestScore - ply) : 0);
+
+    return bestScore;
+}
+
+// Thread::vct() without side and rule parameters starts a VCT search from the
+// root node
+Score Thread::vct(Depth depth) {
+    vctStop = false;
+
+    return Threads.side == 20           ? vct<20, FREESTYLE, PV>(depth, true) :
+           Threads.rule == FREESTYLE ? vct<15, FREESTYLE, PV>(depth, true) :
+           Threads.rule == STANDARD  ? vct<15, STANDARD, PV>(depth, true) :
+                                       vct<15, RENJU, PV>(depth, true);
+}
+
+// Thread::vct() searches for a victory by continuous threats of the side to move.
+// Side to move forms B4 or F3 and opponent tries every defence in vct_defend().
+// A win score is returned only if it is proven, and only proven results are
+// saved in TT so that the entries are valid bounds for alphabeta.
+template <int S, Rule R, NodeType NT>
+Score Thread::vct(Depth depth, bool rootNode) {
+    Board<S> &bd = board<S>();
+
+    const bool PvNode = NT == PV;
+    Piece      piece;
+    int        offset;
+
+    if (!rootNode) {
+        // Update search stats
+        plyMax = std::max(plyMax, ply);
+        ++nodeCnt;
+
+        // Check for win/lose/draw
+        if ((piece = bd.template check_wld<R>(offset)) != PIECE_NONE)
+            return piece == bd.sideToMove ? SCORE_WIN - ply - offset : piece == bd.oppoToMove ? -SCORE_WIN + ply + offset :
+                                                                   piece == PIECE_DRAW        ? SCORE_DRAW :
+                                                                                                SCORE_NONE;
+    }
+
+    // Check timeout of VCT. Timeout of the turn is checked by the time keeper.
+    if (Threads.timeKeeper.elapsed() > vctTime)
+        vctStop = true;
+
+    // Return when stopped, depth reaches zero or ply reaches max depth
+    if (vctStop || Threads.terminate.load(std::memory_order_relaxed) || depth <= DEPTH_ZERO || ply >= DEPTH_MAX - 1)
+        return SCORE_ZERO;
+
+    ExtMove    em;
+    Score      score, bestScore, ttScore;
+    TTEntry    tte;
+    ZobristKey key;
+    bool       ttHit;
+
+    // Initialization
+    bestScore = -SCORE_INF;
+    key       = bd.key;
+
+    // TT cutoff: proven win or lose
+    tte     = TT.probe(key, ttHit);
+    ttScore = ttHit ? score_from_tt(tte.score(), ply) : SCORE_NONE;
+
+    if (!rootNode && ttHit && ((ttScore > SCORE_WIN_THRESHOLD && (tte.bound() & BOUND_LOWER)) || (ttScore < -SCORE_WIN_THRESHOLD && (tte.bound() & BOUND_UPPER)))) {
+        if (PvNode) {
+            if (ttScore > SCORE_WIN_THRESHOLD && is_ok(tte.move()))
+                update_pv(ss[ply].pv, ply, tte.move());
+            else
+                reset_pv(ss[ply].pv, ply);
+        }
+        return ttScore;
+    }
+
+    MoveGen<S> mg(&bd, VCT_TT, MOVE_NONE, rootNode);
+
+    // Loop through all moves until no moves remain or a win move is found
+    while ((em = mg.next_move()).move != MOVE_NONE) {
+        // Make the threat move
+        bd.template do_move<R>(em.move);
+        ++ply;
+        if (PvNode)
+            reset_pv(ss[ply].pv, ply);
+
+        score = -vct_defend<S, R, NT>(depth - 1);
+
+        // Un-make the move
+        bd.undo_move();
+        --ply;
+
+        // Break once a win move is found
+        if (score > SCORE_WIN_THRESHOLD) {
+            bestScore = score;
+
+            if (PvNode)
+                update_pv(ss, ply, em.move);
+
+            TT.save(key, em.move, score_to_tt(bestScore, ply), BOUND_LOWER, false, depth);
             break;
         }
     }
 
     return bestScore;
 }
+
+// Thread::vct_defend() searches all defences of side to move against opponent's
+// B4 or F3 in VCT search. It returns a lose score only if every defence loses.
+template <int S, Rule R, NodeType NT>
+Score Thread::vct_defend(Depth depth) {
+    Board<S> &bd = board<S>();
+
+    const bool PvNode = NT == PV;
+    Piece      piece;
+    int        offset;
+
+    // Update search stats
+    plyMax = std::max(plyMax, ply);
+    ++nodeCnt;
+
+    // Check for win/lose/draw
+    if ((piece = bd.template check_wld<R>(offset)) != PIECE_NONE)
+        return piece == bd.sideToMove ? SCORE_WIN - ply - offset : piece == bd.oppoToMove ? -SCORE_WIN + ply + offset :
+                                                               piece == PIECE_DRAW        ? SCORE_DRAW :
+                                                                                            SCORE_NONE;
+
+    // Return when opponent has no threat, depth reaches zero or ply reaches max depth
+    if ((bd.query(bd.oppoToMove, B4) == 0 && bd.query(bd.oppoToMove, F3) == 0) || depth <= DEPTH_ZERO || ply >= DEPTH_MAX - 1)
+        return SCORE_ZERO;
+
+    ExtMove    em;
+    Score      score, bestScore, ttScore;
+    TTEntry    tte;
+    ZobristKey key;
+    bool       ttHit;
+
+    // Initialization
+    bestScore = SCORE_NONE;
+    key       = bd.key;
+
+    // TT cutoff: proven win or lose
+    tte     = TT.probe(key, ttHit);
+    ttScore = ttHit ? score_from_tt(tte.score(), ply) : SCORE_NONE;
+
+    if (ttHit && ((ttScore > SCORE_WIN_THRESHOLD && (tte.bound() & BOUND_LOWER)) || (ttScore < -SCORE_WIN_THRESHOLD && (tte.bound() & BOUND_UPPER)))) {
+        if (PvNode)
+            reset_pv(ss[ply].pv, ply);
+        return ttScore;
+    }
+
+    MoveGen<S> mg(&bd, VCT_DEFEND_TT, MOVE_NONE);
+
+    // Loop through all defences until no moves remain or one of them holds
+    while ((em = mg.next_move()).move != MOVE_NONE) {
+        // Make the defending move
+        bd.template do_move<R>(em.move);
+        ++ply;
+        if (PvNode)
+            reset_pv(ss[ply].pv, ply);
+
+        score = -vct<S, R, NT>(depth - 1, false);
+
+        // Un-make the move
+        bd.undo_move();
+        --ply;
+
+        // Return once a defence holds
+        if (score > -SCORE_WIN_THRESHOLD)
+            return SCORE_ZERO;
+
+        // Keep the longest losing line
+        if (bestScore == SCORE_NONE || score > bestScore) {
+            bestScore = score;
+
+            if (PvNode)
+                update_pv(ss, ply, em.move);
+        }
+    }
+
+    // No defence is generated
+    if (bestScore == SCORE_NONE)
+        return SCORE_ZERO;
+
+    TT.save(key, MOVE_NONE, score_to_tt(bestScore, ply), BOUND_UPPER, false, depth);
+
+    return bestScore;
+}
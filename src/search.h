@@ -15,10 +15,14 @@
 enum NodeType { NonPV,
                 PV };
 
-typedef NArray<Move, STACK_SIZE>    Pv;
+// Pv of the node at ply p starts at index p, and the pv of a vcf node below
+// DEPTH_MAX ends at index DEPTH_MAX + 1 at most
+typedef NArray<Move, DEPTH_NUM + 1> Pv;
+typedef NArray<Pv, DEPTH_NUM + 1>   PvTable;
 typedef NArray<Move, MOVE_CAPACITY> CounterMoveHistory;
 
-// SearchStackElement records information in the search tree
+// SearchStackElement records information in the search tree. Pv points to a row
+// of the triangular pv table of the thread.
 struct SearchStackElement {
     Pv * pv;
     Move killers[2];
@@ -37,14 +41,16 @@ struct SearchStackElement {
 
 typedef NArray<SearchStackElement, STACK_SIZE> SearchStack;
 
-// RootExtMove struct is a score-depth-pv triple for root nodes.
+// RootExtMove struct is a score-depth-pv triple for root nodes. It also keeps
+// the number of aspiration re-searches of the iteration for statistics.
 struct RootExtMove {
     Score score;
     Depth depth;
     Pv    pv;
+    int   researches;
 
     RootExtMove()
-        : score(SCORE_NONE), depth(DEPTH_ZERO) {
+        : score(SCORE_NONE), depth(DEPTH_ZERO), researches(0) {
         pv[0] = MOVE_NONE;
     }
 
@@ -12,13 +12,36 @@
 
 #include "tt.h"
 
+#include <memory>
+
 ThreadPool Threads;
 
+namespace {
+
+// Allocate the board of side S if missing and free the board of side O
+template <int S, int O>
+void keep_board(Boards &bds) {
+    std::get<std::unique_ptr<Board<O>>>(bds).reset();
+
+    if (!std::get<std::unique_ptr<Board<S>>>(bds))
+        std::get<std::unique_ptr<Board<S>>>(bds) = std::make_unique<Board<S>>();
+}
+
+// Copy the board of side S of from to the one of to, if both are allocated
+template <int S>
+void copy_board(Boards &to, const Boards &from) {
+    if (std::get<std::unique_ptr<Board<S>>>(to) && std::get<std::unique_ptr<Board<S>>>(from))
+        *std::get<std::unique_ptr<Board<S>>>(to) = *std::get<std::unique_ptr<Board<S>>>(from);
+}
+
+} // namespace
+
 // Thread constructor launches the thread and waits until it goes to sleep
 // in idle_loop(). Note that 'searching' and 'exit' should be already set.
 Thread::Thread(size_t n)
     : idx(n), stdThread(&Thread::idle_loop, this) {
     wait_for_search_finished();
+    set_side(Threads.side);
 }
 
 // Thread destructor wakes up the thread in idle_loop() and waits
@@ -31,18 +54,43 @@ Thread::~Thread() {
     stdThread.join();
 }
 
-// Thread::clear_history() resets pv and histories
+void *Thread::operator new(size_t size) {
+    void *mem = aligned_large_pages_alloc(size);
+
+    if (!mem) {
+        sync_cout << "MESSAGE failed to allocate memory for thread" << sync_endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return mem;
+}
+
+void Thread::operator delete(void *p) {
+    aligned_large_pages_free(p);
+}
+
+// Thread::set_side() keeps only the board of the side, so that a thread does
+// not carry the large board of a side which is not played
+void Thread::set_side(int s) {
+    s == 20 ? keep_board<20, 15>(boards) : keep_board<15, 20>(boards);
+}
+
+// Thread::clear_history() resets pv, histories and the VCF cache
 void Thread::clear_history() {
     for (auto &i : ss) {
         i.pv         = nullptr;
         i.killers[0] = i.killers[1] = MOVE_NONE;
     }
     counterMoves.fill(MOVE_NONE);
+    vcfTable.clear();
 }
 
 // Thread::update_history() updates histories with the move
+template <int S>
 void Thread::update_history(Move m) {
-    assert(is_ok(m));
+    assert(is_ok(m, S));
+
+    const Board<S> &bd = board<S>();
 
     ss[ply].update_killers(m);
 
@@ -50,6 +98,9 @@ void Thread::update_history(Move m) {
         counterMoves[bd.last_move(1)] = m;
 }
 
+template void Thread::update_history<15>(Move m);
+template void Thread::update_history<20>(Move m);
+
 // Thread::start_searching() wakes up the thread that will start the search
 void Thread::start_searching() {
     std::lock_guard<std::mutex> lk(mutex);
@@ -72,7 +123,7 @@ void Thread::idle_loop() {
     // some Windows NUMA hardware, for instance in fishtest. To make it simple,
     // just check if running threads are below a threshold, in this case all this
     // NUMA machinery is not needed.
-    if (Threads.threadNum > 8)
+    if (Threads.bind_threads())
         bindThisThread(idx);
 
     while (true) {
@@ -90,38 +141,125 @@ void Thread::idle_loop() {
     }
 }
 
+// new_thread() allocates the thread with index idx. With binding, allocation is
+// done by a helper thread bound as the thread will be, so that the board and
+// stacks are first touched on the local NUMA node.
+template <typename T>
+static T *new_thread(size_t idx) {
+    T *th;
+
+    if (!Threads.bind_threads())
+        return new T(idx);
+
+    std::thread([&] {
+        bindThisThread(idx);
+        th = new T(idx);
+    }).join();
+
+    return th;
+}
+
+TimeKeeper::~TimeKeeper() {
+    if (stdThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            exit = true;
+        }
+        cv.notify_one();
+        stdThread.join();
+    }
+}
+
+// TimeKeeper::start() starts ticking for a new turn. The thread is launched on
+// first use. The clock is the timer of the pool, which is reset just before.
+void TimeKeeper::start() {
+    std::lock_guard<std::mutex> lk(mutex);
+
+    if (!stdThread.joinable())
+        stdThread = std::thread(&TimeKeeper::loop, this);
+
+    elapsedTime = 0;
+    deadline    = 0;
+    stopLatency = -1;
+    running     = true;
+    cv.notify_one();
+}
+
+// TimeKeeper::stop() stops ticking after the search has finished, and measures
+// the stop latency if the time keeper has terminated the search
+void TimeKeeper::stop() {
+    std::lock_guard<std::mutex> lk(mutex);
+
+    if (deadline)
+        stopLatency = Threads.timer.elapsed() - deadline;
+    running = false;
+}
+
+// TimeKeeper::loop() is where the time keeper thread ticks while running and
+// sleeps otherwise
+void TimeKeeper::loop() {
+    std::unique_lock<std::mutex> lk(mutex);
+
+    while (true) {
+        cv.wait(lk, [&] { return running || exit; });
+        if (exit)
+            return;
+
+        const TimePoint tick = Threads.pondering ? MaxTick : std::clamp((Threads.turnTime - elapsedTime) / 8, MinTick, MaxTick);
+
+        cv.wait_for(lk, std::chrono::milliseconds(tick), [&] { return !running || exit; });
+        if (!running)
+            continue;
+
+        const TimePoint elapsed = Threads.timer.elapsed();
+        elapsedTime.store(elapsed, std::memory_order_relaxed);
+
+        if (!deadline && !Threads.pondering && elapsed > Threads.turnTime) {
+            deadline = Threads.turnTime;
+            Threads.terminate.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
 // ThreadPool::set() creates/destroys threads to match the requested number.
 // Created and launched threads will immediately go to sleep in idle_loop.
 // Upon resizing, threads are recreated to allow for binding if necessary.
 void ThreadPool::set(size_t requested) {
+    Boards position;
+
     threadNum = requested;
 
     if (size() > 0) { // destroy any existing thread(s)
         main()->wait_for_search_finished();
 
+        // Keep the current position for the new threads
+        position = std::move(main()->boards);
+
         while (size() > 0)
             delete back(), pop_back();
     }
 
     if (requested > 0) { // create new thread(s)
-        push_back(new MainThread(0));
+        push_back(new_thread<MainThread>(0));
 
         while (size() < requested)
-            push_back(new Thread(size()));
+            push_back(new_thread<Thread>(size()));
         reset();
 
-        // Sync with main thread
-        Thread *mainThread = front();
-        for (Thread *th : *this)
-            if (th != mainThread)
-                th->bd = mainThread->bd;
+        // Sync with the kept position. Board copy is a flat state copy, so
+        // this does not depend on the number of pieces.
+        for (Thread *th : *this) {
+            copy_board<15>(th->boards, position);
+            copy_board<20>(th->boards, position);
+        }
     }
 }
 
-// ThreadPool::reset() resets board and histories for each thread
+// ThreadPool::reset() resets the board of the current side and histories for
+// each thread
 void ThreadPool::reset() {
     for (Thread *th : *this) {
-        th->bd.reset();
+        side == 20 ? th->board<20>().reset() : th->board<15>().reset();
         th->clear_history();
     }
 }
@@ -146,11 +284,99 @@ void ThreadPool::think_and_move() {
         th->reset_search();
 
     set_best_thread_with_rem(main(), SCORE_ZERO, DEPTH_ZERO);
+    stopped   = false;
     terminate = false;
+    timeKeeper.start();
 
     main()->start_searching();
 }
 
+// ThreadPool::stop() stops the search, including a ponder search, and waits
+// until all threads have stopped
+void ThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lk(ponderMutex);
+        terminate = true;
+        stopped   = true;
+    }
+    ponderCv.notify_all();
+
+    for (Thread *th : *this)
+        th->wait_for_search_finished();
+}
+
+// ThreadPool::start_pondering() is called by the main thread after the move is
+// output. It makes the expected reply of the opponent on all boards and sets up
+// a ponder search without time limit. The expected reply is the second move of
+// the best pv, or the TT move. Returns false if there is nothing to ponder on
+// or a stop is already requested.
+bool ThreadPool::start_pondering() {
+    const RootExtMove &best = get_best_thread()->rootBests.back();
+    Move               m    = best.pv[1];
+    bool               found;
+
+    if (check_wld_already() != PIECE_NONE)
+        return false;
+
+    if (!is_ok(m, side))
+        m = TT.probe(key(), found).move();
+
+    if (!is_ok(m, side) || !is_empty(m) || is_foul(m))
+        return false;
+
+    std::lock_guard<std::mutex> lk(ponderMutex);
+
+    if (stopped)
+        return false;
+
+    do_move(m);
+
+    if (check_wld_already() != PIECE_NONE) {
+        undo_move();
+        return false;
+    }
+
+    timer.reset();
+    for (Thread *th : *this)
+        th->reset_search();
+
+    set_best_thread_with_rem(main(), SCORE_ZERO, DEPTH_ZERO);
+    ponderMove = m;
+    pondering  = true;
+    terminate  = false;
+    timeKeeper.start();
+
+    sync_cout << "MESSAGE ponder " << rank_of(m) << "," << file_of(m) << sync_endl;
+    return true;
+}
+
+// ThreadPool::ponderhit() is called when the opponent plays the expected reply.
+// The ponder search turns into the search of this turn, timed from now on.
+void ThreadPool::ponderhit() {
+    std::lock_guard<std::mutex> lk(ponderMutex);
+
+    timer.reset();
+    update_turn_time();
+    timeKeeper.start();
+    pondering = false;
+    ponderCv.notify_all();
+}
+
+// ThreadPool::wait_for_ponder_end() is called by the main thread when the search
+// has finished. A ponder search waits for the ponder hit or a stop. If stopped,
+// the expected reply is taken back and false is returned.
+bool ThreadPool::wait_for_ponder_end() {
+    std::unique_lock<std::mutex> lk(ponderMutex);
+    ponderCv.wait(lk, [&] { return !pondering || stopped; });
+
+    if (!pondering)
+        return true;
+
+    pondering = false;
+    undo_move();
+    return false;
+}
+
 void ThreadPool::set_rule(Rule r) {
     // TT and histories are invalid after rule changes
     if (rule != r) {
@@ -164,22 +390,59 @@ void ThreadPool::set_rule(Rule r) {
         rule = RENJU;
 }
 
+// ThreadPool::set_side() selects the board side of the game and keeps only the
+// board of the side in each thread. Only freestyle is played on the 20x20 board.
+// The board is reset by the caller.
+void ThreadPool::set_side(int s) {
+    assert(s == 15 || s == 20);
+
+    for (Thread *th : *this) {
+        th->wait_for_search_finished();
+        th->set_side(s);
+    }
+
+    // TT and histories are invalid after side changes
+    if (side != s) {
+        TT.clear();
+        clear_history();
+    }
+
+    side = s;
+
+    if (side == 20)
+        set_rule(FREESTYLE);
+}
+
+// The functions below act on the board of the current side, which is the board
+// of the main thread or of all the threads
 bool ThreadPool::is_empty(Move m) const {
-    return board()->is_empty(m);
+    return side == 20 ? board<20>().is_empty(m) : board<15>().is_empty(m);
 }
 
 bool ThreadPool::is_foul(Move m) const {
-    return board()->is_foul(m);
+    return side == 20 ? board<20>().is_foul(m) : board<15>().is_foul(m);
+}
+
+Piece ThreadPool::check_wld_already() const {
+    return side == 20 ? board<20>().check_wld_already() : board<15>().check_wld_already();
+}
+
+ZobristKey ThreadPool::key() const {
+    return side == 20 ? board<20>().key : board<15>().key;
+}
+
+Move ThreadPool::last_move() const {
+    return side == 20 ? board<20>().last_move(1) : board<15>().last_move(1);
 }
 
 void ThreadPool::do_move(Move m) {
     for (Thread *th : *this)
-        th->bd.do_move(m);
+        side == 20 ? th->board<20>().do_move(m) : th->board<15>().do_move(m);
 }
 
 void ThreadPool::undo_move() {
     for (Thread *th : *this)
-        th->bd.undo_move();
+        side == 20 ? th->board<20>().undo_move() : th->board<15>().undo_move();
 }
 
 Depth ThreadPool::get_ply_max() {
@@ -196,6 +459,20 @@ uint64_t ThreadPool::get_node_cnt() {
     return cnt;
 }
 
+uint64_t ThreadPool::get_vcf_hits() {
+    uint64_t cnt = 0;
+    for (Thread *th : *this)
+        cnt += th->vcfTable.hits;
+    return cnt;
+}
+
+uint64_t ThreadPool::get_vcf_misses() {
+    uint64_t cnt = 0;
+    for (Thread *th : *this)
+        cnt += th->vcfTable.misses;
+    return cnt;
+}
+
 Score ThreadPool::get_rem_score() {
     std::lock_guard<std::mutex> lk(mutex);
     return rem.score;
@@ -12,10 +12,18 @@
 
 #include "board.h"
 #include "search.h"
+#include "tt.h"
 
+#include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <tuple>
+
+// Boards of the supported sides. Each thread allocates only the board of the
+// side of the game and searches on it.
+typedef std::tuple<std::unique_ptr<Board<15>>, std::unique_ptr<Board<20>>> Boards;
 
 // Thread class keeps together thread and search related stuff
 class Thread {
@@ -23,30 +31,55 @@ public:
     explicit Thread(size_t n);
     virtual ~Thread();
 
+    // Threads are allocated on large pages, as the stacks and histories are large
+    // and accessed all over in search
+    static void *operator new(size_t size);
+    static void  operator delete(void *p);
+
     void idle_loop();
     void start_searching();
     void wait_for_search_finished();
 
+    template <int S>
+    Board<S> &board() {
+        assert(std::get<std::unique_ptr<Board<S>>>(boards));
+
+        return *std::get<std::unique_ptr<Board<S>>>(boards);
+    }
+    void set_side(int s);
+
     void clear_history();
+    template <int S>
     void update_history(Move m);
     void reset_alphabeta();
     void reset_search();
     void print_message() const;
 
     virtual void search();
-    template <NodeType NT>
+    Score        aspiration_search();
+    Score        alphabeta(Score alpha, Score beta, Depth depth);
+    template <int S, Rule R, NodeType NT>
     Score alphabeta(Score alpha, Score beta, Depth depth, bool cautious);
-    template <NodeType NT>
+    template <int S, Rule R, NodeType NT>
     Score vcf(Depth depth, bool rootNode);
+    Score vct(Depth depth);
+    template <int S, Rule R, NodeType NT>
+    Score vct(Depth depth, bool rootNode);
+    template <int S, Rule R, NodeType NT>
+    Score vct_defend(Depth depth);
 
     // Single thread level data members
-    Board                    bd;
+    Boards                   boards;
     Depth                    ply, plyMax, itDepth;
     uint64_t                 nodeCnt;
-    Pv                       rootPv;
+    int                      researches;
+    TimePoint                vctTime;
+    bool                     vctStop;
+    PvTable                  pvTable;
     SearchStack              ss;
     CounterMoveHistory       counterMoves;
     std::vector<RootExtMove> rootBests;
+    VcfTable                 vcfTable;
 
 private:
     // Thread related stuff
@@ -61,6 +94,42 @@ private:
 struct MainThread : public Thread {
     using Thread::Thread;
     void search() override;
+    bool think();
+    template <int S>
+    bool think();
+};
+
+// TimeKeeper class runs a thread that owns the deadline of the turn. While
+// ticking, it publishes the elapsed time and raises the terminate flag of the
+// pool when the turn time is over, so that search threads only read atomics
+// in the hot path instead of calling the clock. It ticks faster as the deadline
+// comes closer, so that it rarely wakes up in long turns.
+class TimeKeeper {
+public:
+    static constexpr TimePoint MinTick = 1, MaxTick = 20; // In milliseconds
+
+    ~TimeKeeper();
+
+    void start();
+    void stop();
+
+    TimePoint elapsed() const {
+        return elapsedTime.load(std::memory_order_relaxed);
+    }
+
+    // Time from the deadline to the end of the last search that is stopped by
+    // the time keeper, or -1 if the search stopped by itself
+    TimePoint stopLatency = -1;
+
+private:
+    void loop();
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::thread             stdThread;
+    bool                    running = false, exit = false;
+    std::atomic<TimePoint>  elapsedTime{0};
+    TimePoint               deadline = 0;
 };
 
 // ThreadPool struct handles all the threads-related stuff like init, starting,
@@ -74,8 +143,14 @@ struct ThreadPool : public std::vector<Thread *> {
     MainThread *main() const {
         return static_cast<MainThread *>(front());
     }
-    Board *board() const {
-        return &(main()->bd);
+    template <int S>
+    Board<S> &board() const {
+        return main()->board<S>();
+    }
+
+    // Binding is needed only with many threads, unless forced by the option
+    bool bind_threads() const {
+        return bindMode == 1 || (bindMode == -1 && threadNum > 8);
     }
 
     // Methods for protocol level call
@@ -83,15 +158,25 @@ struct ThreadPool : public std::vector<Thread *> {
     void reset();
     void clear_history();
     void think_and_move();
-
-    void set_rule(Rule r);
-    bool is_empty(Move m) const;
-    bool is_foul(Move m) const;
-    void do_move(Move m);
-    void undo_move();
+    void stop();
+    bool start_pondering();
+    void ponderhit();
+    bool wait_for_ponder_end();
+
+    void       set_rule(Rule r);
+    void       set_side(int s);
+    bool       is_empty(Move m) const;
+    bool       is_foul(Move m) const;
+    Piece      check_wld_already() const;
+    ZobristKey key() const;
+    Move       last_move() const;
+    void       do_move(Move m);
+    void       undo_move();
 
     Depth    get_ply_max();
     uint64_t get_node_cnt();
+    uint64_t get_vcf_hits();
+    uint64_t get_vcf_misses();
     Score    get_rem_score();
     Depth    get_rem_depth();
     Thread * get_best_thread();
@@ -100,25 +185,35 @@ struct ThreadPool : public std::vector<Thread *> {
     void update_turn_time();
 
     // Data members shared between all threads
-    Rule   rule       = FREESTYLE;
-    bool   yxprotocol = false;
-    bool   terminate  = false;
-    size_t threadNum  = 1;
+    Rule              rule       = FREESTYLE;
+    int               side       = 15;
+    bool              yxprotocol = false;
+    std::atomic<bool> terminate{false};
+    size_t            threadNum  = 1;
+    int               bindMode   = -1; // 0 never binds threads, 1 always, -1 automatic
+    Depth             depthLimit = DEPTH_ITERATIVE_MAX;
+    bool              ponderMode = false;
+    std::atomic<bool> pondering{false};
+    Move              ponderMove = MOVE_NONE;
 
     TimePoint timeoutTurn  = 2147483647;
     TimePoint timeoutMatch = 2147483647;
     TimePoint timeLeft     = 2147483647;
 
-    TimePoint turnTime;
-    TimePoint turnTimeMax;
-    TimePoint turnTimeMin;
+    std::atomic<TimePoint> turnTime;
+    TimePoint              turnTimeMax;
+    TimePoint              turnTimeMin;
 
     TimeManagement timer;
+    TimeKeeper     timeKeeper;
 
 private:
-    std::mutex  mutex;
-    RootExtMove rem;
-    Thread *    bestThread;
+    std::mutex              mutex;
+    RootExtMove             rem;
+    Thread *                bestThread;
+    std::mutex              ponderMutex;
+    std::condition_variable ponderCv;
+    bool                    stopped = false; // Stop is requested since the turn started
 };
 
 extern ThreadPool Threads;
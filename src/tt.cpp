@@ -12,40 +12,57 @@
 
 #include "thread.h"
 
+#include <cstring>
+#include <fstream>
+
+#if defined(USE_SSE2)
+#    include <emmintrin.h>
+#endif
+
 TranspositionTable TT; // Our global transposition table
 
-// TTEntry::save() populates the TTEntry with a new node's data, possibly
-// overwriting an old position. Update is not atomic and can be racy.
-void TTEntry::save(ZobristKey k, Move m, Score s, Bound b, bool pv, Depth d) {
-    // Preserve any existing move for the same position
-    if (m || (uint32_t)k != key32)
-        move16 = m;
+namespace {
 
-    // Overwrite less valuable entries
-    if (b == BOUND_EXACT || (uint32_t)k != key32 || d > depth8 - 4) {
-        key32     = (uint32_t)k;
-        score16   = s;
-        genBound8 = (Bound)(TT.generation8 | uint8_t(pv) << 2 | b);
-        depth8    = d;
-    }
-}
+// A hash file consists of a header, zero padding up to HashFileDataOffset and
+// the raw cluster array. The offset is a multiple of both the page size and the
+// Windows allocation granularity, so that the clusters can be mapped directly.
+constexpr char     HashFileMagic[8]   = {'P', 'Z', 'H', 'A', 'S', 'H', 0, 0};
+constexpr uint32_t HashFileVersion    = 2; // Increase when the entry format changes
+constexpr size_t   HashFileDataOffset = 65536;
+
+struct HashFileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t boardSide;
+    uint32_t rule;
+    uint32_t entrySize;
+    uint32_t clusterSize;
+    uint32_t generation;
+    uint64_t clusterCount;
+};
+
+} // namespace
 
 // TranspositionTable::resize() sets the size of the transposition table,
 // measured in megabytes. Transposition table consists of a power of 2 number
-// of clusters and each cluster consists of ClusterSize number of TTEntry.
+// of clusters and each cluster consists of ClusterSize number of entries.
 void TranspositionTable::resize(size_t mbSize) {
+    PageBacking backing;
+
     Threads.main()->wait_for_search_finished();
 
-    aligned_large_pages_free(table);
+    free_table();
 
     clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
 
-    table = static_cast<Cluster *>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
+    table = static_cast<Cluster *>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster), &backing));
     if (!table) {
         sync_cout << "MESSAGE failed to allocate " << mbSize << "mb for transposition table" << sync_endl;
         exit(EXIT_FAILURE);
     }
 
+    sync_cout << "MESSAGE hash " << mbSize << "mb on " << page_backing_name(backing) << sync_endl;
+
     clear();
 }
 
@@ -57,7 +74,7 @@ void TranspositionTable::clear() {
     for (size_t idx = 0; idx < Threads.threadNum; ++idx) {
         threads.emplace_back([this, idx]() {
             // Thread binding gives faster search on systems with a first-touch policy
-            if (Threads.threadNum > 8)
+            if (Threads.bind_threads())
                 bindThisThread(idx);
 
             // Each thread will zero its part of the hash table
@@ -67,7 +84,7 @@ void TranspositionTable::clear() {
                                       stride :
                                       clusterCount - start;
 
-            std::memset(&table[start], 0, len * sizeof(Cluster));
+            std::memset(static_cast<void *>(&table[start]), 0, len * sizeof(Cluster));
         });
     }
 
@@ -75,33 +92,244 @@ void TranspositionTable::clear() {
         th.join();
 }
 
+// TranspositionTable::free_table() releases the table, either allocated or
+// mapped from a hash file
+void TranspositionTable::free_table() {
+    mapped ? unmap_file(table, clusterCount * sizeof(Cluster)) : aligned_large_pages_free(table);
+
+    table  = nullptr;
+    mapped = false;
+}
+
+// TranspositionTable::save_file() dumps the transposition table to a hash file.
+// It must not be called during searching. Returns false if writing fails.
+bool TranspositionTable::save_file(const std::string &path) const {
+    std::ofstream     ofs(path, std::ios::binary);
+    HashFileHeader    header;
+    std::vector<char> padding(HashFileDataOffset - sizeof(header), 0);
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, HashFileMagic, sizeof(header.magic));
+    header.version      = HashFileVersion;
+    header.boardSide    = Threads.side;
+    header.rule         = Threads.rule;
+    header.entrySize    = EntrySize;
+    header.clusterSize  = ClusterSize;
+    header.generation   = generation8;
+    header.clusterCount = clusterCount;
+
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(padding.data(), padding.size());
+    ofs.write(reinterpret_cast<const char *>(table), clusterCount * sizeof(Cluster));
+    ofs.close();
+
+    return !ofs.fail();
+}
+
+// TranspositionTable::load_file() restores the transposition table from a hash
+// file saved with the same board size, rule and entry format. The table takes
+// the size of the saved table. The clusters are mapped from the file when the
+// system supports it, so that even a large table is ready without reading the
+// whole file. Returns false and keeps the current table if the file is invalid
+// or cannot be read.
+bool TranspositionTable::load_file(const std::string &path) {
+    std::ifstream  ifs(path, std::ios::binary | std::ios::ate);
+    HashFileHeader header;
+
+    if (!ifs)
+        return false;
+
+    const size_t fileSize = size_t(ifs.tellg());
+
+    ifs.seekg(0);
+    if (!ifs.read(reinterpret_cast<char *>(&header), sizeof(header))
+        || std::memcmp(header.magic, HashFileMagic, sizeof(header.magic))
+        || header.version != HashFileVersion
+        || header.boardSide != uint32_t(Threads.side)
+        || header.rule != uint32_t(Threads.rule)
+        || header.entrySize != EntrySize
+        || header.clusterSize != ClusterSize
+        || header.clusterCount == 0
+        || fileSize != HashFileDataOffset + header.clusterCount * sizeof(Cluster))
+        return false;
+
+    Threads.main()->wait_for_search_finished();
+
+    // The new table is ready before the current one is released
+    const size_t size     = header.clusterCount * sizeof(Cluster);
+    Cluster *    newTable = static_cast<Cluster *>(map_file(path, HashFileDataOffset, size));
+    const bool   isMapped = newTable != nullptr;
+
+    // Fall back to reading the whole file
+    if (!isMapped) {
+        newTable = static_cast<Cluster *>(aligned_large_pages_alloc(size));
+        if (!newTable) {
+            sync_cout << "MESSAGE failed to allocate " << size / 1024 / 1024 << "mb for transposition table" << sync_endl;
+            return false;
+        }
+
+        ifs.seekg(HashFileDataOffset);
+        if (!ifs.read(reinterpret_cast<char *>(newTable), size)) {
+            aligned_large_pages_free(newTable);
+            return false;
+        }
+    }
+
+    free_table();
+
+    table        = newTable;
+    mapped       = isMapped;
+    clusterCount = header.clusterCount;
+    generation8  = uint8_t(header.generation);
+
+    return true;
+}
+
 // TranspositionTable::probe() looks up the current position in the transposition
-// table. It returns true and a pointer to the TTEntry if the position is found.
-// Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
-// to be replaced later. The replace value of an entry is calculated as its depth
-// minus 8 times its relative age. TTEntry t1 is considered more valuable than
-// TTEntry t2 if its replace value is greater than that of t2.
-TTEntry *TranspositionTable::probe(const ZobristKey key, bool &found) const {
-    TTEntry *const tte   = first_entry(key);
-    const uint32_t key32 = (uint32_t)key; // Use the low 32 bits as key inside the cluster
-
-    for (int i = 0; i < ClusterSize; ++i)
-        if (tte[i].key32 == key32 || !tte[i].depth8) {
-            tte[i].genBound8 = Bound(generation8 | (tte[i].genBound8 & (GENERATION_DELTA - 1))); // Refresh
-
-            return found = (bool)tte[i].depth8, &tte[i];
+// table. It returns true and a copy of the entry if the position is found.
+// Otherwise, it returns false and an empty entry. The data word is loaded by a
+// single atomic access and must agree with the check word on the full key, so
+// an entry of another position or torn between two writers is a miss.
+TTEntry TranspositionTable::probe(const ZobristKey key, bool &found) const {
+    Cluster &      c     = table[mul_hi64(key, clusterCount)];
+    const uint16_t key16 = (uint16_t)key; // Use the low 16 bits to match inside the cluster
+    const int      i     = first_match(c, key16);
+
+    if (i >= 0) {
+        TTEntry tte(c.entry[i].load(std::memory_order_relaxed));
+
+        // The entry may have been rewritten since the match, so check it again
+        if (tte.depth() && (c.check[i].load(std::memory_order_relaxed) ^ tte.data64) == key) {
+            TTEntry  refreshed = tte;
+            uint64_t expected  = tte.data64;
+
+            // Refresh. Skip it if another thread has rewritten the entry meanwhile.
+            // A reader between the two stores sees a mismatch and misses.
+            refreshed.set(key16, tte.move(), tte.score(), uint8_t(generation8 | (tte.gen_bound() & (GENERATION_DELTA - 1))), tte.depth());
+            if (refreshed.data64 != expected && c.entry[i].compare_exchange_strong(expected, refreshed.data64, std::memory_order_relaxed))
+                c.check[i].store(key ^ refreshed.data64, std::memory_order_relaxed);
+
+            return found = true, tte;
+        }
+    }
+
+    return found = false, TTEntry();
+}
+
+// TranspositionTable::save() populates an entry with a new node's data, possibly
+// overwriting an old position. The entry of the same position or an empty entry
+// is preferred, otherwise the least valuable entry of the cluster is replaced.
+// The data word and the check word are written by one atomic store each.
+// Concurrent saves to the same entry may leave the data of one and the check of
+// the other, which fails the check and is never returned by probe().
+void TranspositionTable::save(const ZobristKey key, Move m, Score s, Bound b, bool pv, Depth d) {
+    Cluster &      c     = table[mul_hi64(key, clusterCount)];
+    const uint16_t key16 = (uint16_t)key;
+    int            ind   = first_match(c, key16);
+
+    if (ind < 0)
+        ind = victim(c);
+
+    const TTEntry old(c.entry[ind].load(std::memory_order_relaxed));
+    const bool    same = (c.check[ind].load(std::memory_order_relaxed) ^ old.data64) == key;
+    TTEntry       neo  = old;
+
+    // Preserve any existing move for the same position
+    if (m || !same)
+        neo.set(key16, m, old.score(), old.gen_bound(), old.depth());
+
+    // Overwrite less valuable entries
+    if (b == BOUND_EXACT || !same || d > old.depth() - 4)
+        neo.set(key16, neo.move(), s, uint8_t(generation8 | uint8_t(pv) << 2 | b), d);
+
+    if (neo.data64 != old.data64 || !same) {
+        c.entry[ind].store(neo.data64, std::memory_order_relaxed);
+        c.check[ind].store(key ^ neo.data64, std::memory_order_relaxed);
+    }
+}
+
+// TranspositionTable::first_match() returns the index of the first entry in the
+// cluster which has the key or is empty, or -1 if there is no such entry. Entries
+// are filled in order, so an empty entry ends the search. With SSE2 the keys and
+// depths of two entries are compared at once. The caller must load the matched
+// entry again atomically before using it.
+int TranspositionTable::first_match(const Cluster &c, uint16_t key16) const {
+#if defined(USE_SSE2)
+    const __m128i *p    = reinterpret_cast<const __m128i *>(c.entry);
+    const __m128i  keys = _mm_set1_epi16(short(key16));
+    const __m128i  zero = _mm_setzero_si128();
+    int            mask = 0;
+
+    for (int i = 0; i < ClusterSize / 2; ++i) {
+        const __m128i v = _mm_load_si128(p + i);
+
+        // Byte 0 and 1 of an entry hold the key and byte 7 holds the depth
+        const int m = (_mm_movemask_epi8(_mm_cmpeq_epi16(v, keys)) & 0x0101) | (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0x8080);
+
+        mask |= (bool(m & 0x00ff) | bool(m & 0xff00) << 1) << (i * 2);
+    }
+
+    return mask ? lsb(mask) : -1;
+#else
+    for (int i = 0; i < ClusterSize; ++i) {
+        const TTEntry tte(c.entry[i].load(std::memory_order_relaxed));
+
+        if (tte.key16() == key16 || !tte.depth())
+            return i;
+    }
+
+    return -1;
+#endif
+}
+
+// TranspositionTable::victim() returns the index of the entry to be replaced,
+// which is the first entry with the lowest replace value in the cluster. With
+// SSE2 the replace values of all entries are calculated at once.
+int TranspositionTable::victim(const Cluster &c) const {
+#if defined(USE_SSE2)
+    const __m128i *p = reinterpret_cast<const __m128i *>(c.entry);
+
+    // Gather the top 16 bits of each data word (generation and bound in the low
+    // byte, depth in the high byte) into 32 bits lanes. The 2 entries cluster
+    // just repeats itself in the other lanes.
+    const __m128i lo   = _mm_shuffle_epi32(_mm_srli_epi64(_mm_load_si128(p), 48), _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i hi   = ClusterSize == 4 ? _mm_shuffle_epi32(_mm_srli_epi64(_mm_load_si128(p + 1), 48), _MM_SHUFFLE(3, 1, 2, 0)) : lo;
+    const __m128i half = _mm_unpacklo_epi64(lo, hi);
+
+    // Depth is below 128, so the packing does not saturate
+    const __m128i top   = _mm_packs_epi32(half, half);
+    const __m128i age   = _mm_and_si128(_mm_sub_epi16(_mm_set1_epi16(short(GENERATION_CYCLE + generation8)), _mm_and_si128(top, _mm_set1_epi16(0xff))), _mm_set1_epi16(GENERATION_MASK));
+    const __m128i value = _mm_sub_epi16(_mm_srli_epi16(top, 8), age);
+
+    // Horizontal minimum, then the first lane having it
+    __m128i mn = _mm_min_epi16(value, _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2)));
+    mn         = _mm_min_epi16(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+    mn         = _mm_min_epi16(mn, _mm_shufflelo_epi16(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+    mn         = _mm_set1_epi16(short(_mm_extract_epi16(mn, 0)));
+
+    return lsb(_mm_movemask_epi8(_mm_cmpeq_epi16(value, mn)) & ((1 << ClusterSize * 2) - 1)) / 2;
+#else
+    int ind = 0, value = replace_value(TTEntry(c.entry[0].load(std::memory_order_relaxed)));
+
+    for (int i = 1; i < ClusterSize; ++i) {
+        const int v = replace_value(TTEntry(c.entry[i].load(std::memory_order_relaxed)));
+
+        if (value > v) {
+            ind   = i;
+            value = v;
         }
+    }
+
+    return ind;
+#endif
+}
 
-    // Find an entry to be replaced according to the replacement strategy
-    TTEntry *replace = tte;
-    for (int i = 1; i < ClusterSize; ++i)
-        // Due to our packed storage format for generation and its cyclic
-        // nature we add GENERATION_CYCLE (256 is the modulus, plus what
-        // is needed to keep the unrelated lowest n bits from affecting
-        // the result) to calculate the entry age correctly even after
-        // generation8 overflows into the next cycle.
-        if (replace->depth8 - ((GENERATION_CYCLE + generation8 - replace->genBound8) & GENERATION_MASK) > tte[i].depth8 - ((GENERATION_CYCLE + generation8 - tte[i].genBound8) & GENERATION_MASK))
-            replace = &tte[i];
-
-    return found = false, replace;
+// TranspositionTable::replace_value() returns the replace value of an entry,
+// which is its depth minus 8 times its relative age. Due to our packed storage
+// format for generation and its cyclic nature we add GENERATION_CYCLE (256 is
+// the modulus, plus what is needed to keep the unrelated lowest n bits from
+// affecting the result) to calculate the entry age correctly even after
+// generation8 overflows into the next cycle.
+int TranspositionTable::replace_value(const TTEntry &tte) const {
+    return tte.depth() - ((GENERATION_CYCLE + generation8 - tte.gen_bound()) & GENERATION_MASK);
 }
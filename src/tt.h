@@ -12,10 +12,16 @@
 
 #include "type.h"
 
-#pragma pack(push, 2)
-
-// TTEntry struct is the 10 bytes transposition table entry, defined as below:
-// key        32 bit
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// TTEntry struct is the 8 bytes data word of a transposition table entry. All
+// fields are packed into one 64-bit word as below, so that the data is always
+// loaded and stored by a single atomic access. The table keeps a check word of
+// the full key xor the data word next to it, which validates the whole key and
+// detects an entry torn between two writers:
+// key        16 bit, for matching before the check
 // move       16 bit
 // score      16 bit
 // generation  5 bit
@@ -23,51 +29,65 @@
 // pv node     1 bit
 // depth       8 bit
 struct TTEntry {
+    explicit TTEntry(uint64_t d = 0) : data64(d) {}
+
     Move move() const {
-        return move16;
+        return Move(uint16_t(data64 >> 16));
     }
     Score score() const {
-        return score16;
+        return Score(int16_t(data64 >> 32));
     }
     bool is_pv() const {
-        return (bool)(genBound8 & 0x4);
+        return (bool)(gen_bound() & 0x4);
     }
     Bound bound() const {
-        return Bound(genBound8 & 0x3);
+        return Bound(gen_bound() & 0x3);
     }
     Depth depth() const {
-        return depth8;
+        return Depth(int8_t(data64 >> 56));
     }
-    void save(ZobristKey k, Move m, Score sc, Bound b, bool pv, Depth d);
 
 private:
     friend class TranspositionTable;
 
-    uint32_t key32;
-    Move     move16;
-    Score    score16;
-    Bound    genBound8;
-    Depth    depth8;
-};
+    uint16_t key16() const {
+        return uint16_t(data64);
+    }
+    uint8_t gen_bound() const {
+        return uint8_t(data64 >> 48);
+    }
+    void set(uint16_t k, Move m, Score s, uint8_t gb, Depth d) {
+        data64 = uint64_t(k) | uint64_t(uint16_t(m)) << 16 | uint64_t(uint16_t(s)) << 32 | uint64_t(gb) << 48 | uint64_t(uint8_t(d)) << 56;
+    }
 
-#pragma pack(pop)
+    uint64_t data64;
+};
 
-static_assert(sizeof(TTEntry) == 10, "TT entry size should be 10 bytes");
+static_assert(sizeof(TTEntry) == 8, "TT data word should be 8 bytes");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "TT entry should be accessed lock-free");
 
 // A TranspositionTable is an array of Cluster, of size clusterCount. Each
-// cluster consists of ClusterSize number of TTEntry. Each non-empty TTEntry
-// contains information on exactly one position. The size of a Cluster should
-// divide the size of a cache line for best performance, as the cacheline is
-// prefetched when possible.
+// cluster consists of ClusterSize number of entries, each stored as an atomic
+// 64-bit data word and an atomic 64-bit check word. The data words are kept
+// together so that they are matched at once. Each non-empty entry contains
+// information on exactly one position. The size of a Cluster should divide the
+// size of a cache line for best performance, as the cacheline is prefetched
+// when possible. A cluster is 32 bytes with 2 entries by default, or a whole 64
+// bytes cache line with 4 entries if TT_CLUSTER_64 is defined.
 class TranspositionTable {
-    static constexpr int ClusterSize = 3;
+#ifdef TT_CLUSTER_64
+    static constexpr int ClusterSize = 4;
+#else
+    static constexpr int ClusterSize = 2;
+#endif
 
     struct Cluster {
-        TTEntry entry[ClusterSize];
-        char    padding[2]; // Pad to 32 bytes
+        std::atomic<uint64_t> entry[ClusterSize];
+        std::atomic<uint64_t> check[ClusterSize]; // Key xor data word
     };
 
-    static_assert(sizeof(Cluster) == 32, "Unexpected Cluster size");
+    static_assert(sizeof(Cluster) == ClusterSize * 2 * sizeof(TTEntry), "Unexpected Cluster size");
+    static_assert(64 % sizeof(Cluster) == 0, "Cluster size should divide the size of a cache line");
 
     // Constants used to refresh the hash table periodically
     static constexpr unsigned GENERATION_BITS  = 3;                                // nb of bits reserved for other things
@@ -76,26 +96,82 @@ class TranspositionTable {
     static constexpr int      GENERATION_MASK  = (0xFF << GENERATION_BITS) & 0xFF; // mask to pull out generation number
 
 public:
+    static constexpr size_t EntrySize = 2 * sizeof(TTEntry); // Data word and check word
+
     ~TranspositionTable() {
-        aligned_large_pages_free(table);
+        free_table();
     }
     void new_search() {
         generation8 += GENERATION_DELTA;
     } // Lower bits are used for other things
-    TTEntry* probe(const ZobristKey key, bool& found) const;
-    void     resize(size_t mbSize);
-    void     clear();
-
-    TTEntry* first_entry(const ZobristKey key) const {
+    TTEntry probe(const ZobristKey key, bool& found) const;
+    void    save(const ZobristKey key, Move m, Score s, Bound b, bool pv, Depth d);
+    void    resize(size_t mbSize);
+    void    clear();
+    bool    save_file(const std::string& path) const;
+    bool    load_file(const std::string& path);
+
+    std::atomic<uint64_t>* first_entry(const ZobristKey key) const {
         return &table[mul_hi64(key, clusterCount)].entry[0];
     }
+    size_t mb_size() const {
+        return clusterCount * sizeof(Cluster) / (1024 * 1024);
+    }
 
 private:
-    friend struct TTEntry;
+    int  first_match(const Cluster& c, uint16_t key16) const;
+    int  victim(const Cluster& c) const;
+    int  replace_value(const TTEntry& tte) const;
+    void free_table();
 
     size_t   clusterCount;
     Cluster* table;
-    uint8_t  generation8; // Size must be not bigger than TTEntry::genBound8
+    uint8_t  generation8;    // Size must be not bigger than the generation and bound field
+    bool     mapped = false; // Table is mapped from a hash file instead of allocated
 };
 
 extern TranspositionTable TT;
+
+// VcfEntry struct is the 8 bytes VCF cache entry. A win entry keeps the first
+// attacking move and the number of plies to win. A no-win entry keeps MOVE_NONE
+// and means no win is found within the searched depth.
+struct VcfEntry {
+    uint32_t key32;
+    Move     move;
+    Depth    depth;
+    uint8_t  distance;
+};
+
+static_assert(sizeof(VcfEntry) == 8, "VCF entry size should be 8 bytes");
+
+// VcfTable class is a small direct-mapped cache of VCF search results. Each
+// thread owns one, so entries are accessed without atomics and always replaced.
+// Side to move and the search area are folded into the key because both of
+// them change the result of a VCF search. The area is MOVE_NONE for a VCF root
+// searching the whole board, or the center of the neighborhood for a child.
+class VcfTable {
+    static constexpr size_t Size = 1 << 16;
+
+public:
+    const VcfEntry *probe(ZobristKey key, Piece side, Move area) {
+        key                = mix(key, side, area);
+        const VcfEntry *ve = &table[key & (Size - 1)];
+        return ve->key32 == uint32_t(key >> 32) && ve->depth > DEPTH_ZERO ? ve : nullptr;
+    }
+    void save(ZobristKey key, Piece side, Move area, Move m, Depth d, int dist) {
+        key                     = mix(key, side, area);
+        table[key & (Size - 1)] = {uint32_t(key >> 32), m, d, uint8_t(dist)};
+    }
+    void clear() {
+        std::fill(table.begin(), table.end(), VcfEntry{0, MOVE_NONE, DEPTH_ZERO, 0});
+    }
+
+    uint64_t hits = 0, misses = 0;
+
+private:
+    static ZobristKey mix(ZobristKey key, Piece side, Move area) {
+        return key ^ uint64_t(side == WHITE) ^ uint64_t(area) << 1;
+    }
+
+    std::vector<VcfEntry> table = std::vector<VcfEntry>(Size);
+};
@@ -0,0 +1,114 @@
+/*      _____                __    ______
+ *     / ___ \              / /   /___  /
+ *    / /__/ /___  ____  __/ /_______/ /    ____  ____
+ *   / _____/ __ \/ __ \/_   _/ __  / /    / __ \/ __ \
+ *  / /    /  ___/ / / / / /_/ /_/ / /____/  ___/ / / /
+ * /_/     \____/_/ /_/ /___/\__,_/______/\____/_/ /_/
+ *
+ * PentaZen, a Gomoku/Renju playing engine developed by Sun Yuliang.
+ */
+
+// Stress test hammering TranspositionTable::probe() and save() from many threads
+// on a small table. Every field saved for a key is derived from the key, so any
+// hit returning other data is a torn or a false entry. Half of the keys have a
+// twin differing only in bits which neither the cluster index nor the 16 bits
+// match key use, so a check of less than the full key is caught as well.
+// Usage: ttstress [threads = 16] [ops per thread = 4194304] [mb = 1]
+
+#include "thread.h"
+#include "tt.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int KeyCnt = 1 << 16;
+
+struct Expected {
+    Move  move;
+    Score score;
+    Bound bound;
+    bool  pv;
+    Depth depth;
+};
+
+Expected expected_of(ZobristKey key) {
+    return {Move(1 + key % (MOVE_CAPACITY - 1)),
+            Score(int(key >> 20 & 0x3fff) - 8192),
+            Bound(1 + (key >> 36) % 3),
+            bool(key >> 40 & 1),
+            Depth(1 + (key >> 44) % 100)};
+}
+
+struct ThreadStats {
+    uint64_t probes = 0, hits = 0, errors = 0;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    const int      threadCnt = argc > 1 ? std::atoi(argv[1]) : 16;
+    const uint64_t ops       = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1 << 22;
+    const int      mbSize    = argc > 3 ? std::atoi(argv[3]) : 1;
+
+    pattern_init(binary_directory(argv[0]));
+    Threads.set(1);
+    TT.resize(mbSize);
+    TT.new_search();
+
+    std::vector<ZobristKey> keys(KeyCnt);
+    PRNG                    rng(1070372);
+
+    for (auto i = 0; i < KeyCnt; i += 2) {
+        keys[i]     = rng.rand<ZobristKey>();
+        keys[i + 1] = i % 4 ? rng.rand<ZobristKey>() : keys[i] ^ (uint64_t(1) << 24);
+    }
+
+    std::vector<ThreadStats> stats(threadCnt);
+    std::vector<std::thread> threads;
+
+    for (auto t = 0; t < threadCnt; ++t)
+        threads.emplace_back([&, t]() {
+            PRNG         r(uint64_t(t) * 0x9E3779B97F4A7C15ULL + 1);
+            ThreadStats &st = stats[t];
+            bool         found;
+
+            for (uint64_t i = 0; i < ops; ++i) {
+                const uint64_t   rnd = r.rand<uint64_t>();
+                const ZobristKey key = keys[rnd % KeyCnt];
+                const Expected   e   = expected_of(key);
+
+                if (rnd >> 63) {
+                    TT.save(key, e.move, e.score, e.bound, e.pv, e.depth);
+                    continue;
+                }
+
+                const TTEntry tte = TT.probe(key, found);
+
+                ++st.probes;
+                if (!found)
+                    continue;
+
+                ++st.hits;
+                if (tte.move() != e.move || tte.score() != e.score || tte.bound() != e.bound || tte.is_pv() != e.pv || tte.depth() != e.depth)
+                    ++st.errors;
+            }
+        });
+
+    for (auto &th : threads)
+        th.join();
+
+    ThreadStats total;
+
+    for (auto &st : stats) {
+        total.probes += st.probes;
+        total.hits += st.hits;
+        total.errors += st.errors;
+    }
+
+    std::cout << threadCnt << " threads, " << mbSize << "mb, probes " << total.probes << " hits " << total.hits
+              << " errors " << total.errors << std::endl;
+
+    return total.errors ? 1 : 0;
+}
@@ -18,24 +18,16 @@
 #define ENGINE_VERSION "0.4.17"
 #define ENGINE_AUTHOR "Sun Yuliang"
 
-#define BOARD_SIDE_EQUALS_15
-// #define BOARD_SIDE_EQUALS_20
-
-// Search and board constants
-constexpr bool OUTPUT_MESSAGE = 1;
-#ifdef BOARD_SIDE_EQUALS_20
-constexpr int BOARD_SIDE = 20;
-constexpr int TT_SIZE    = 128;
-#endif
-#ifdef BOARD_SIDE_EQUALS_15
-constexpr int BOARD_SIDE = 15;
-constexpr int TT_SIZE    = 256;
-#endif
-constexpr int BOARD_SIDE_BIT      = 5;
-constexpr int BOARD_SIDE_CAPACITY = 1 << BOARD_SIDE_BIT;
-constexpr int BOARD_BOUNDARY      = 4;
-constexpr int STACK_SIZE          = BOARD_SIDE * BOARD_SIDE + 1;
-constexpr int VECTOR_SIZE         = BOARD_SIDE * 6 - 2;
+// Search and board constants. The board side is a template parameter of the
+// board, move generator and search, and each supported side is instantiated.
+// Sizes not depending on the side in use are large enough for the largest board.
+constexpr bool OUTPUT_MESSAGE      = 1;
+constexpr int  BOARD_SIDE_MAX      = 20;
+constexpr int  TT_SIZE             = 256;
+constexpr int  BOARD_SIDE_BIT      = 5;
+constexpr int  BOARD_SIDE_CAPACITY = 1 << BOARD_SIDE_BIT;
+constexpr int  BOARD_BOUNDARY      = 4;
+constexpr int  STACK_SIZE          = BOARD_SIDE_MAX * BOARD_SIDE_MAX + 1;
 
 typedef uint64_t ZobristKey;
 
@@ -49,7 +41,7 @@ enum Rule {
 
 enum Move : uint16_t {
     MOVE_NONE     = 0, // must be 0
-    MOVE_SIZE     = BOARD_SIDE * BOARD_SIDE,
+    MOVE_SIZE     = BOARD_SIDE_MAX * BOARD_SIDE_MAX,
     MOVE_CAPACITY = BOARD_SIDE_CAPACITY * BOARD_SIDE_CAPACITY,
 };
 
@@ -335,8 +327,10 @@ constexpr Direction operator~(Direction d) {
                                                 DIRECTION_NUM;
 }
 
-constexpr bool is_ok(Move m) {
-    return 0 <= rank_of(m) && rank_of(m) < BOARD_SIDE && 0 <= file_of(m) && file_of(m) < BOARD_SIDE;
+// Return true if the move is on the board of the side. Without the side, it is
+// checked on the largest board, which is enough for assertions.
+constexpr bool is_ok(Move m, int side = BOARD_SIDE_MAX) {
+    return 0 <= rank_of(m) && rank_of(m) < side && 0 <= file_of(m) && file_of(m) < side;
 }
 
 constexpr bool is_ok(Score s) {
@@ -358,8 +352,16 @@ inline T get_bits(T a, int begin, int end) {
     return (a >> begin) & ((1u << (end - begin)) - 1);
 }
 
+// Return the move in algebraic notation on the board of the side, e.g. "h8" for
+// the center of the 15x15 board
+inline std::string move_to_string(Move m, int side) {
+    return m != MOVE_NONE ? char('a' + file_of(m)) + std::to_string(side - rank_of(m)) : "NONE";
+}
+
+// Moves are printed as "rank,file" of the protocol, which does not depend on the
+// board side. Use move_to_string() for the algebraic notation.
 inline std::ostream &operator<<(std::ostream &os, Move m) {
-    m != MOVE_NONE ? std::cout << char('a' + file_of(m)) << BOARD_SIDE - rank_of(m) : std::cout << "NONE";
+    m != MOVE_NONE ? std::cout << rank_of(m) << "," << file_of(m) : std::cout << "NONE";
     return os;
 }
 